@@ -15,14 +15,23 @@ private:
     SightRead::Metadata m_metadata;
     SightRead::HopoThreshold m_hopo_threshold;
     std::set<SightRead::Instrument> m_permitted_instruments;
+    std::set<SightRead::Difficulty> m_permitted_difficulties;
     bool m_permit_solos;
+    unsigned int m_thread_count;
 
 public:
     explicit ChartParser(SightRead::Metadata metadata);
     ChartParser& hopo_threshold(SightRead::HopoThreshold hopo_threshold);
     ChartParser&
     permit_instruments(std::set<SightRead::Instrument> permitted_instruments);
+    ChartParser&
+    permit_difficulties(std::set<SightRead::Difficulty> permitted_difficulties);
     ChartParser& parse_solos(bool permit_solos);
+    // Threads used to convert instrument tracks, 0 = one per hardware
+    // thread. The song is the same whatever the count.
+    ChartParser& thread_count(unsigned int thread_count);
+    // Sections for instruments or difficulties that aren't permitted are
+    // skipped without being parsed.
     SightRead::Song parse(std::string_view data) const;
 };
 }
@@ -17,6 +17,7 @@ private:
     SightRead::HopoThreshold m_hopo_threshold;
     std::set<SightRead::Instrument> m_permitted_instruments;
     bool m_permit_solos;
+    unsigned int m_thread_count;
 
 public:
     explicit MidiParser(SightRead::Metadata metadata);
@@ -24,6 +25,9 @@ public:
     MidiParser&
     permit_instruments(std::set<SightRead::Instrument> permitted_instruments);
     MidiParser& parse_solos(bool permit_solos);
+    // Threads used to convert instrument tracks, 0 = one per hardware
+    // thread. The song is the same whatever the count.
+    MidiParser& thread_count(unsigned int thread_count);
     SightRead::Song parse(std::span<const std::uint8_t> data) const;
 };
 }
@@ -6,6 +6,7 @@
 #include <memory>
 #include <optional>
 #include <set>
+#include <span>
 #include <string>
 #include <utility>
 #include <vector>
@@ -210,7 +211,12 @@ private:
     TrackType m_track_type;
     std::shared_ptr<SongGlobalData> m_global_data;
     int m_base_score_ticks;
+    // Start ticks of m_notes and m_sp_phrases, kept as flat arrays so range
+    // queries binary search a few cache lines instead of the Note structs.
+    std::vector<int> m_note_ticks;
+    std::vector<int> m_sp_ticks;
 
+    void build_position_index();
     void compute_base_score_ticks();
     void merge_same_time_notes();
     void add_hopos(SightRead::Tick max_hopo_gap);
@@ -227,6 +233,16 @@ public:
     {
         return m_sp_phrases;
     }
+    // Notes and SP phrases starting in [start, end), in O(log n).
+    [[nodiscard]] std::span<const Note>
+    notes_in_range(SightRead::Tick start, SightRead::Tick end) const;
+    [[nodiscard]] int note_count_in_range(SightRead::Tick start,
+                                          SightRead::Tick end) const
+    {
+        return static_cast<int>(notes_in_range(start, end).size());
+    }
+    [[nodiscard]] std::span<const StarPower>
+    sp_phrases_in_range(SightRead::Tick start, SightRead::Tick end) const;
 
     [[nodiscard]] std::vector<Solo>
     solos(const SightRead::DrumSettings& drum_settings) const;
@@ -9,7 +9,12 @@ SightRead::ChartParser::ChartParser(SightRead::Metadata metadata)
     , m_hopo_threshold {SightRead::HopoThresholdType::Resolution,
                         SightRead::Tick {0}}
     , m_permitted_instruments {SightRead::all_instruments()}
+    , m_permitted_difficulties {SightRead::Difficulty::Easy,
+                                SightRead::Difficulty::Medium,
+                                SightRead::Difficulty::Hard,
+                                SightRead::Difficulty::Expert}
     , m_permit_solos {true}
+    , m_thread_count {0}
 {
 }
 
@@ -27,19 +32,35 @@ SightRead::ChartParser& SightRead::ChartParser::permit_instruments(
     return *this;
 }
 
+SightRead::ChartParser& SightRead::ChartParser::permit_difficulties(
+    std::set<SightRead::Difficulty> permitted_difficulties)
+{
+    m_permitted_difficulties = std::move(permitted_difficulties);
+    return *this;
+}
+
 SightRead::ChartParser& SightRead::ChartParser::parse_solos(bool permit_solos)
 {
     m_permit_solos = permit_solos;
     return *this;
 }
 
-SightRead::Song SightRead::ChartParser::parse(std::string_view data) const
+SightRead::ChartParser&
+SightRead::ChartParser::thread_count(unsigned int thread_count)
 {
-    const auto chart = SightRead::Detail::parse_chart(data);
+    m_thread_count = thread_count;
+    return *this;
+}
 
+SightRead::Song SightRead::ChartParser::parse(std::string_view data) const
+{
     const auto converter = SightRead::Detail::ChartConverter(m_metadata)
                                .hopo_threshold(m_hopo_threshold)
                                .permit_instruments(m_permitted_instruments)
-                               .parse_solos(m_permit_solos);
+                               .permit_difficulties(m_permitted_difficulties)
+                               .parse_solos(m_permit_solos)
+                               .thread_count(m_thread_count);
+    const auto chart = SightRead::Detail::parse_chart(
+        data, [&](auto name) { return converter.wants_section(name); });
     return converter.convert(chart);
 }
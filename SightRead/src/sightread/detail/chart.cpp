@@ -1,36 +1,209 @@
+#include <array>
+#include <bit>
 #include <charconv>
+#include <cstdint>
+#include <cstring>
 #include <optional>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)                                     \
+    || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SIGHTREAD_CHART_SSE2
+#include <emmintrin.h>
+#endif
+
 #include "sightread/detail/chart.hpp"
 #include "sightread/songparts.hpp"
 
 namespace {
-std::string_view skip_whitespace(std::string_view input)
+constexpr std::size_t BLOCK_SIZE = 64;
+
+bool is_whitespace(char c)
 {
-    const auto first_non_ws_location = input.find_first_not_of(" \f\n\r\t\v");
-    input.remove_prefix(std::min(first_non_ws_location, input.size()));
-    return input;
+    return c == ' ' || c == '\f' || c == '\n' || c == '\r' || c == '\t'
+        || c == '\v';
 }
 
-std::string_view break_off_newline(std::string_view& input)
+// Bitmask of the bytes in a 64 byte block that end a line ('\n') or a field
+// (' ').
+std::uint64_t boundary_mask(const char* block)
 {
-    if (input.empty()) {
-        throw SightRead::ParseError("No lines left");
+#if defined(__AVX2__)
+    const auto newline = _mm256_set1_epi8('\n');
+    const auto space = _mm256_set1_epi8(' ');
+    std::uint64_t mask = 0;
+    for (auto i = 0U; i < BLOCK_SIZE; i += 32) {
+        const auto bytes = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(block + i));
+        const auto hits = _mm256_or_si256(_mm256_cmpeq_epi8(bytes, newline),
+                                          _mm256_cmpeq_epi8(bytes, space));
+        mask |= std::uint64_t {static_cast<std::uint32_t>(
+                    _mm256_movemask_epi8(hits))}
+            << i;
+    }
+    return mask;
+#elif defined(SIGHTREAD_CHART_SSE2)
+    const auto newline = _mm_set1_epi8('\n');
+    const auto space = _mm_set1_epi8(' ');
+    std::uint64_t mask = 0;
+    for (auto i = 0U; i < BLOCK_SIZE; i += 16) {
+        const auto bytes
+            = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + i));
+        const auto hits = _mm_or_si128(_mm_cmpeq_epi8(bytes, newline),
+                                       _mm_cmpeq_epi8(bytes, space));
+        mask |= std::uint64_t {static_cast<std::uint16_t>(
+                    _mm_movemask_epi8(hits))}
+            << i;
+    }
+    return mask;
+#else
+    std::uint64_t mask = 0;
+    for (auto i = 0U; i < BLOCK_SIZE; ++i) {
+        if (block[i] == '\n' || block[i] == ' ') {
+            mask |= std::uint64_t {1} << i;
+        }
+    }
+    return mask;
+#endif
+}
+
+// Finds line and field boundaries a block at a time. The lexer only moves
+// forward, so each block is classified once.
+class BoundaryScanner {
+private:
+    std::string_view m_data;
+    std::size_t m_block = std::string_view::npos;
+    std::uint64_t m_mask = 0;
+
+    void load(std::size_t block)
+    {
+        if (block + BLOCK_SIZE <= m_data.size()) {
+            m_mask = boundary_mask(m_data.data() + block);
+        } else {
+            std::array<char, BLOCK_SIZE> padded {};
+            std::memcpy(padded.data(), m_data.data() + block,
+                        m_data.size() - block);
+            m_mask = boundary_mask(padded.data());
+        }
+        m_block = block;
+    }
+
+public:
+    explicit BoundaryScanner(std::string_view data)
+        : m_data {data}
+    {
+    }
+
+    // Position of the first '\n' or ' ' at or after pos, or the size of the
+    // data if there is none.
+    std::size_t next(std::size_t pos)
+    {
+        while (pos < m_data.size()) {
+            const auto block = pos - pos % BLOCK_SIZE;
+            if (block != m_block) {
+                load(block);
+            }
+            const auto mask = m_mask & (~std::uint64_t {0} << (pos - block));
+            if (mask != 0) {
+                return block + static_cast<std::size_t>(std::countr_zero(mask));
+            }
+            pos = block + BLOCK_SIZE;
+        }
+        return m_data.size();
     }
+};
 
-    const auto newline_location
-        = std::min(input.find('\n'), input.find("\r\n"));
-    if (newline_location == std::string_view::npos) {
-        const auto line = input;
-        input.remove_prefix(input.size());
+// A line split by single spaces, like .Split(' ') in C#. Only the first few
+// fields are kept, which is all any record needs; field_count is the real
+// number. The views live as long as the chart text.
+struct ChartLine {
+    static constexpr std::size_t MAX_FIELDS = 5;
+
+    std::string_view text;
+    std::array<std::string_view, MAX_FIELDS> fields;
+    std::size_t field_count = 0;
+
+    // Everything from field i to the end of the line
+    [[nodiscard]] std::string_view from_field(std::size_t i) const
+    {
+        const auto offset = static_cast<std::size_t>(fields[i].data() - text.data());
+        return text.substr(offset);
+    }
+};
+
+// Hands out the chart's lines in one forward pass. Lines end at "\n" or
+// "\r\n" (a lone '\r' is kept), and whitespace after a line break is skipped,
+// so blank lines and indentation vanish.
+class ChartLexer {
+private:
+    std::string_view m_data;
+    BoundaryScanner m_scanner;
+    std::size_t m_pos = 0;
+
+public:
+    explicit ChartLexer(std::string_view data)
+        : m_data {data}
+        , m_scanner {data}
+    {
+    }
+
+    [[nodiscard]] bool empty() const { return m_pos >= m_data.size(); }
+    [[nodiscard]] std::size_t position() const { return m_pos; }
+
+    // Carry on from pos, which must not be behind the current position. The
+    // whitespace there is skipped as after a line break.
+    void skip_to(std::size_t pos)
+    {
+        m_pos = pos;
+        skip_whitespace();
+    }
+
+    ChartLine next_line()
+    {
+        if (empty()) {
+            throw SightRead::ParseError("No lines left");
+        }
+
+        ChartLine line;
+        const auto start = m_pos;
+        auto field_start = start;
+        auto end = m_scanner.next(field_start);
+        while (end < m_data.size() && m_data[end] == ' ') {
+            if (line.field_count < ChartLine::MAX_FIELDS) {
+                line.fields[line.field_count]
+                    = m_data.substr(field_start, end - field_start);
+            }
+            ++line.field_count;
+            field_start = end + 1;
+            end = m_scanner.next(field_start);
+        }
+
+        auto text_end = end;
+        if (end < m_data.size() && text_end > start
+            && m_data[text_end - 1] == '\r') {
+            --text_end;
+        }
+        if (line.field_count < ChartLine::MAX_FIELDS) {
+            line.fields[line.field_count]
+                = m_data.substr(field_start, text_end - field_start);
+        }
+        ++line.field_count;
+        line.text = m_data.substr(start, text_end - start);
+
+        m_pos = end;
+        skip_whitespace();
         return line;
     }
 
-    const auto line = input.substr(0, newline_location);
-    input.remove_prefix(newline_location);
-    input = skip_whitespace(input);
-    return line;
-}
+private:
+    void skip_whitespace()
+    {
+        while (m_pos < m_data.size() && is_whitespace(m_data[m_pos])) {
+            ++m_pos;
+        }
+    }
+};
 
 std::string_view strip_square_brackets(std::string_view input)
 {
@@ -53,87 +226,63 @@ std::optional<int> string_view_to_int(std::string_view input)
     return result;
 }
 
-// Split input by space characters, similar to .Split(' ') in C#. Note that
-// the lifetime of the string_views in the output is the same as that of the
-// input.
-std::vector<std::string_view> split_by_space(std::string_view input)
-{
-    std::vector<std::string_view> substrings;
-
-    while (true) {
-        const auto space_location = input.find(' ');
-        if (space_location == std::string_view::npos) {
-            break;
-        }
-        substrings.push_back(input.substr(0, space_location));
-        input.remove_prefix(space_location + 1);
-    }
-
-    substrings.push_back(input);
-    return substrings;
-}
-
-SightRead::Detail::NoteEvent
-convert_line_to_note(int position,
-                     const std::vector<std::string_view>& split_line)
+SightRead::Detail::NoteEvent convert_line_to_note(int position,
+                                                  const ChartLine& line)
 {
     constexpr int MAX_NORMAL_EVENT_SIZE = 5;
 
-    if (split_line.size() < MAX_NORMAL_EVENT_SIZE) {
+    if (line.field_count < MAX_NORMAL_EVENT_SIZE) {
         throw SightRead::ParseError("Line incomplete");
     }
-    const auto fret = string_view_to_int(split_line[3]);
-    const auto length = string_view_to_int(split_line[4]);
+    const auto fret = string_view_to_int(line.fields[3]);
+    const auto length = string_view_to_int(line.fields[4]);
     if (!fret.has_value() || !length.has_value()) {
         throw SightRead::ParseError("Bad note event");
     }
     return {position, *fret, *length};
 }
 
-SightRead::Detail::SpecialEvent
-convert_line_to_special(int position,
-                        const std::vector<std::string_view>& split_line)
+SightRead::Detail::SpecialEvent convert_line_to_special(int position,
+                                                        const ChartLine& line)
 {
     constexpr int MAX_NORMAL_EVENT_SIZE = 5;
 
-    if (split_line.size() < MAX_NORMAL_EVENT_SIZE) {
+    if (line.field_count < MAX_NORMAL_EVENT_SIZE) {
         throw SightRead::ParseError("Line incomplete");
     }
-    const auto sp_key = string_view_to_int(split_line[3]);
-    const auto length = string_view_to_int(split_line[4]);
+    const auto sp_key = string_view_to_int(line.fields[3]);
+    const auto length = string_view_to_int(line.fields[4]);
     if (!sp_key.has_value() || !length.has_value()) {
         throw SightRead::ParseError("Bad SP event");
     }
     return {position, *sp_key, *length};
 }
 
-SightRead::Detail::BpmEvent
-convert_line_to_bpm(int position,
-                    const std::vector<std::string_view>& split_line)
+SightRead::Detail::BpmEvent convert_line_to_bpm(int position,
+                                                const ChartLine& line)
 {
-    if (split_line.size() < 4) {
+    if (line.field_count < 4) {
         throw SightRead::ParseError("Line incomplete");
     }
-    const auto bpm = string_view_to_int(split_line[3]);
+    const auto bpm = string_view_to_int(line.fields[3]);
     if (!bpm.has_value()) {
         throw SightRead::ParseError("Bad BPM event");
     }
     return {position, *bpm};
 }
 
-SightRead::Detail::TimeSigEvent
-convert_line_to_timesig(int position,
-                        const std::vector<std::string_view>& split_line)
+SightRead::Detail::TimeSigEvent convert_line_to_timesig(int position,
+                                                        const ChartLine& line)
 {
     constexpr int MAX_NORMAL_EVENT_SIZE = 5;
 
-    if (split_line.size() < 4) {
+    if (line.field_count < 4) {
         throw SightRead::ParseError("Line incomplete");
     }
-    const auto numer = string_view_to_int(split_line[3]);
+    const auto numer = string_view_to_int(line.fields[3]);
     std::optional<int> denom = 2;
-    if (split_line.size() >= MAX_NORMAL_EVENT_SIZE) {
-        denom = string_view_to_int(split_line[4]);
+    if (line.field_count >= MAX_NORMAL_EVENT_SIZE) {
+        denom = string_view_to_int(line.fields[4]);
     }
     if (!numer.has_value() || !denom.has_value()) {
         throw SightRead::ParseError("Bad TS event");
@@ -141,68 +290,117 @@ convert_line_to_timesig(int position,
     return {position, *numer, *denom};
 }
 
-SightRead::Detail::Event
-convert_line_to_event(int position,
-                      const std::vector<std::string_view>& split_line)
+SightRead::Detail::Event convert_line_to_event(int position,
+                                               const ChartLine& line)
 {
-    if (split_line.size() < 4) {
+    if (line.field_count < 4) {
         throw SightRead::ParseError("Line incomplete");
     }
-    SightRead::Detail::Event event;
-    event.position = position;
-    for (auto i = 3U; i < split_line.size(); ++i) {
-        event.data += split_line[i];
-        if (i + 1 != split_line.size()) {
-            event.data += ' ';
+    // the fields joined back up with single spaces are just the rest of the
+    // line
+    return {position, line.from_field(3)};
+}
+
+// Position of the '}' line closing a section whose lines start at body_start
+// (npos if there isn't one),
+// found by looking at braces alone: a '}' with only whitespace back to a line
+// break (or the body start) and a line break or the end of the text after.
+// That's exactly a line the lexer would read as "}".
+std::size_t find_closing_brace(std::string_view data, std::size_t body_start)
+{
+    auto pos = body_start;
+    while (true) {
+        pos = data.find('}', pos);
+        if (pos == std::string_view::npos) {
+            return pos;
+        }
+
+        auto line_start = pos;
+        while (line_start > body_start && data[line_start - 1] != '\n'
+               && is_whitespace(data[line_start - 1])) {
+            --line_start;
         }
+        const auto starts_line
+            = line_start == body_start || data[line_start - 1] == '\n';
+        const auto rest = data.substr(pos + 1);
+        const auto ends_line = rest.empty() || rest.starts_with('\n')
+            || rest.starts_with("\r\n");
+        if (starts_line && ends_line) {
+            return pos;
+        }
+        ++pos;
     }
-    return event;
 }
 
-SightRead::Detail::ChartSection read_section(std::string_view& input)
+SightRead::Detail::ChartSection
+read_section(const SightRead::Detail::ChartSectionIndex& index);
+
+// Reads a section's header and opening brace and finds its end, leaving the
+// lexer after the closing brace.
+SightRead::Detail::ChartSectionIndex index_section(ChartLexer& lexer,
+                                                   std::string_view data)
 {
-    SightRead::Detail::ChartSection section;
-    section.name = strip_square_brackets(break_off_newline(input));
+    SightRead::Detail::ChartSectionIndex index;
+    index.name = strip_square_brackets(lexer.next_line().text);
 
-    if (break_off_newline(input) != "{") {
+    if (lexer.next_line().text != "{") {
         throw SightRead::ParseError("Section does not open with {");
     }
 
-    while (true) {
-        const auto next_line = break_off_newline(input);
-        if (next_line == "}") {
-            break;
-        }
-        const auto separated_line = split_by_space(next_line);
-        if (separated_line.size() < 3) {
+    const auto body_start = lexer.position();
+    const auto body_end = find_closing_brace(data, body_start);
+    if (body_end == std::string_view::npos) {
+        // a bad line before the end of the text is the better error
+        index.body = data.substr(body_start);
+        read_section(index);
+        throw SightRead::ParseError("No lines left");
+    }
+    index.body = data.substr(body_start, body_end - body_start);
+    lexer.skip_to(body_end + 1);
+    return index;
+}
+
+SightRead::Detail::ChartSection
+read_section(const SightRead::Detail::ChartSectionIndex& index)
+{
+    SightRead::Detail::ChartSection section;
+    section.name = index.name;
+    ChartLexer lexer {index.body};
+
+    while (!lexer.empty()) {
+        const auto line = lexer.next_line();
+        if (line.field_count < 3) {
             throw SightRead::ParseError("Line incomplete");
         }
-        const auto key = separated_line[0];
+        const auto key = line.fields[0];
         const auto key_val = string_view_to_int(key);
         if (key_val.has_value()) {
             const auto pos = *key_val;
-            if (separated_line[2] == "N") {
-                section.note_events.push_back(
-                    convert_line_to_note(pos, separated_line));
-            } else if (separated_line[2] == "S") {
+            const auto type = line.fields[2];
+            if (type == "N") {
+                section.note_events.push_back(convert_line_to_note(pos, line));
+            } else if (type == "S") {
                 section.special_events.push_back(
-                    convert_line_to_special(pos, separated_line));
-            } else if (separated_line[2] == "B") {
-                section.bpm_events.push_back(
-                    convert_line_to_bpm(pos, separated_line));
-            } else if (separated_line[2] == "TS") {
+                    convert_line_to_special(pos, line));
+            } else if (type == "B") {
+                section.bpm_events.push_back(convert_line_to_bpm(pos, line));
+            } else if (type == "TS") {
                 section.ts_events.push_back(
-                    convert_line_to_timesig(pos, separated_line));
-            } else if (separated_line[2] == "E") {
-                section.events.push_back(
-                    convert_line_to_event(pos, separated_line));
+                    convert_line_to_timesig(pos, line));
+            } else if (type == "E") {
+                section.events.push_back(convert_line_to_event(pos, line));
             }
         } else {
-            std::string value {separated_line[2]};
-            for (auto i = 3U; i < separated_line.size(); ++i) {
-                value.append(separated_line[i]);
+            // the value's fields are run together without their spaces
+            const auto rest = line.from_field(2);
+            std::string value;
+            value.reserve(rest.size());
+            for (const auto c : rest) {
+                if (c != ' ') {
+                    value.push_back(c);
+                }
             }
-            section.key_value_pairs[std::string(key)] = value;
+            section.key_value_pairs[std::string(key)] = std::move(value);
         }
     }
 
@@ -210,12 +408,44 @@ SightRead::Detail::ChartSection read_section(std::string_view& input)
 }
 }
 
+std::vector<SightRead::Detail::ChartSectionIndex>
+SightRead::Detail::index_chart(std::string_view data)
+{
+    std::vector<SightRead::Detail::ChartSectionIndex> sections;
+    ChartLexer lexer {data};
+
+    while (!lexer.empty()) {
+        sections.push_back(index_section(lexer, data));
+    }
+
+    return sections;
+}
+
+SightRead::Detail::ChartSection
+SightRead::Detail::parse_section(const ChartSectionIndex& index)
+{
+    return read_section(index);
+}
+
 SightRead::Detail::Chart SightRead::Detail::parse_chart(std::string_view data)
+{
+    return parse_chart(data, [](auto) { return true; });
+}
+
+SightRead::Detail::Chart SightRead::Detail::parse_chart(
+    std::string_view data,
+    const std::function<bool(std::string_view)>& wanted)
 {
     SightRead::Detail::Chart chart;
+    ChartLexer lexer {data};
 
-    while (!data.empty()) {
-        chart.sections.push_back(read_section(data));
+    // each section is parsed as soon as it's found, so errors come in the
+    // order they're in the text
+    while (!lexer.empty()) {
+        const auto index = index_section(lexer, data);
+        if (wanted(index.name)) {
+            chart.sections.push_back(read_section(index));
+        }
     }
 
     return chart;
@@ -1,6 +1,7 @@
 #ifndef SIGHTREAD_DETAIL_CHART_HPP
 #define SIGHTREAD_DETAIL_CHART_HPP
 
+#include <functional>
 #include <map>
 #include <string>
 #include <string_view>
@@ -14,7 +15,7 @@ struct BpmEvent {
 
 struct Event {
     int position;
-    std::string data;
+    std::string_view data; // points into the text given to parse_chart
 };
 
 struct NoteEvent {
@@ -49,7 +50,27 @@ struct Chart {
     std::vector<ChartSection> sections;
 };
 
+// Where a section sits in the chart text, found without reading its lines.
+// Both views point into the text.
+struct ChartSectionIndex {
+    std::string_view name;
+    std::string_view body; // the lines between { and }
+};
+
+// First pass: every section's name and body, found from the braces alone.
+// Lines inside sections aren't checked until they're parsed.
+std::vector<ChartSectionIndex> index_chart(std::string_view data);
+
+// Second pass, for one section of the index.
+ChartSection parse_section(const ChartSectionIndex& index);
+
+// The chart's events point into data, so it must outlive the chart.
 Chart parse_chart(std::string_view data);
+
+// As above, but only the sections wanted(name) accepts are parsed, the rest
+// are skipped unread and left out.
+Chart parse_chart(std::string_view data,
+                  const std::function<bool(std::string_view)>& wanted);
 }
 
 #endif
@@ -1,5 +1,8 @@
 #include <algorithm>
+#include <array>
 #include <climits>
+#include <exception>
+#include <initializer_list>
 #include <map>
 #include <optional>
 #include <tuple>
@@ -68,7 +71,7 @@ practice_sections_from_section(const SightRead::Detail::ChartSection& section)
 }
 
 std::optional<std::tuple<SightRead::Difficulty, SightRead::Instrument>>
-diff_inst_from_header(const std::string& header)
+diff_inst_from_header(std::string_view header)
 {
     using namespace std::literals;
 
@@ -107,66 +110,83 @@ diff_inst_from_header(const std::string& header)
     return std::tuple {std::get<1>(*diff_iter), std::get<1>(*inst_iter)};
 }
 
-std::optional<SightRead::Note>
-note_from_colour_key_map(const std::map<int, int>& colour_map, int position,
-                         int length, int fret_type, SightRead::NoteFlags flags)
+// Where a .chart fret number puts a note, and the flags it gets. Frets are
+// small, so each track type has a dense table indexed by fret and a note is
+// a bounds check and a load rather than a map lookup.
+struct ChartLane {
+    int colour;
+    SightRead::NoteFlags flags;
+};
+
+constexpr int LANE_TABLE_SIZE = 69;
+
+using LaneTable = std::array<ChartLane, LANE_TABLE_SIZE>;
+
+constexpr LaneTable make_lane_table(
+    std::initializer_list<std::tuple<int, int>> fret_colours,
+    SightRead::NoteFlags flags)
 {
-    const auto colour_iter = colour_map.find(fret_type);
-    if (colour_iter == colour_map.end()) {
-        return std::nullopt;
+    LaneTable lanes {};
+    for (auto& lane : lanes) {
+        lane = {-1, SightRead::FLAGS_NONE};
     }
-    SightRead::Note note;
-    note.position = SightRead::Tick {position};
-    note.lengths.at(static_cast<unsigned int>(colour_iter->second))
-        = SightRead::Tick {length};
-    note.flags = flags;
-    return note;
+    for (const auto& [fret, colour] : fret_colours) {
+        lanes.at(static_cast<std::size_t>(fret)) = {colour, flags};
+    }
+    return lanes;
 }
 
-std::optional<SightRead::Note>
-note_from_note_colour(int position, int length, int fret_type,
-                      SightRead::TrackType track_type)
+constexpr LaneTable FIVE_FRET_LANES
+    = make_lane_table({{0, SightRead::FIVE_FRET_GREEN},
+                       {1, SightRead::FIVE_FRET_RED},
+                       {2, SightRead::FIVE_FRET_YELLOW},
+                       {3, SightRead::FIVE_FRET_BLUE},
+                       {4, SightRead::FIVE_FRET_ORANGE},
+                       {7, SightRead::FIVE_FRET_OPEN}}, // NOLINT
+                      SightRead::FLAGS_FIVE_FRET_GUITAR);
+
+constexpr LaneTable SIX_FRET_LANES
+    = make_lane_table({{0, SightRead::SIX_FRET_WHITE_LOW},
+                       {1, SightRead::SIX_FRET_WHITE_MID},
+                       {2, SightRead::SIX_FRET_WHITE_HIGH},
+                       {3, SightRead::SIX_FRET_BLACK_LOW},
+                       {4, SightRead::SIX_FRET_BLACK_MID},
+                       {7, SightRead::SIX_FRET_OPEN}, // NOLINT
+                       {8, SightRead::SIX_FRET_BLACK_HIGH}}, // NOLINT
+                      SightRead::FLAGS_SIX_FRET_GUITAR);
+
+constexpr LaneTable DRUM_LANES = [] {
+    constexpr int CYMBAL_THRESHOLD = 64;
+
+    auto lanes = make_lane_table({{0, SightRead::DRUM_KICK},
+                                  {1, SightRead::DRUM_RED},
+                                  {2, SightRead::DRUM_YELLOW},
+                                  {3, SightRead::DRUM_BLUE},
+                                  {4, SightRead::DRUM_GREEN},
+                                  {32, SightRead::DRUM_DOUBLE_KICK}, // NOLINT
+                                  {66, SightRead::DRUM_YELLOW}, // NOLINT
+                                  {67, SightRead::DRUM_BLUE}, // NOLINT
+                                  {68, SightRead::DRUM_GREEN}}, // NOLINT
+                                 SightRead::FLAGS_DRUMS);
+    for (auto fret = CYMBAL_THRESHOLD; fret < LANE_TABLE_SIZE; ++fret) {
+        auto& lane = lanes.at(static_cast<std::size_t>(fret));
+        if (lane.colour != -1) {
+            lane.flags = static_cast<SightRead::NoteFlags>(
+                lane.flags | SightRead::FLAGS_CYMBAL);
+        }
+    }
+    return lanes;
+}();
+
+const LaneTable& lane_table(SightRead::TrackType track_type)
 {
-    std::map<int, int> colours;
     switch (track_type) {
     case SightRead::TrackType::FiveFret:
-        colours = {{0, SightRead::FIVE_FRET_GREEN},
-                   {1, SightRead::FIVE_FRET_RED},
-                   {2, SightRead::FIVE_FRET_YELLOW},
-                   {3, SightRead::FIVE_FRET_BLUE},
-                   {4, SightRead::FIVE_FRET_ORANGE},
-                   {7, SightRead::FIVE_FRET_OPEN}}; // NOLINT
-        return note_from_colour_key_map(colours, position, length, fret_type,
-                                        SightRead::FLAGS_FIVE_FRET_GUITAR);
+        return FIVE_FRET_LANES;
     case SightRead::TrackType::SixFret:
-        colours = {{0, SightRead::SIX_FRET_WHITE_LOW},
-                   {1, SightRead::SIX_FRET_WHITE_MID},
-                   {2, SightRead::SIX_FRET_WHITE_HIGH},
-                   {3, SightRead::SIX_FRET_BLACK_LOW},
-                   {4, SightRead::SIX_FRET_BLACK_MID},
-                   {7, SightRead::SIX_FRET_OPEN}, // NOLINT
-                   {8, SightRead::SIX_FRET_BLACK_HIGH}}; // NOLINT
-        return note_from_colour_key_map(colours, position, length, fret_type,
-                                        SightRead::FLAGS_SIX_FRET_GUITAR);
-    case SightRead::TrackType::Drums: {
-        constexpr int CYMBAL_THRESHOLD = 64;
-        colours = {{0, SightRead::DRUM_KICK},
-                   {1, SightRead::DRUM_RED},
-                   {2, SightRead::DRUM_YELLOW},
-                   {3, SightRead::DRUM_BLUE},
-                   {4, SightRead::DRUM_GREEN},
-                   {32, SightRead::DRUM_DOUBLE_KICK}, // NOLINT
-                   {66, SightRead::DRUM_YELLOW}, // NOLINT
-                   {67, SightRead::DRUM_BLUE}, // NOLINT
-                   {68, SightRead::DRUM_GREEN}}; // NOLINT
-        auto note = note_from_colour_key_map(colours, position, length,
-                                             fret_type, SightRead::FLAGS_DRUMS);
-        if (note.has_value() && fret_type >= CYMBAL_THRESHOLD) {
-            note->flags = static_cast<SightRead::NoteFlags>(
-                note->flags | SightRead::FLAGS_CYMBAL);
-        }
-        return note;
-    }
+        return SIX_FRET_LANES;
+    case SightRead::TrackType::Drums:
+        return DRUM_LANES;
     case SightRead::TrackType::FortniteFestival:
         throw std::invalid_argument(
             ".chart files not supported with Fortnite Festival");
@@ -175,6 +195,25 @@ note_from_note_colour(int position, int length, int fret_type,
     throw std::invalid_argument("Invalid track type");
 }
 
+std::optional<SightRead::Note> note_from_note_colour(int position, int length,
+                                                     int fret_type,
+                                                     const LaneTable& lanes)
+{
+    if (fret_type < 0 || fret_type >= LANE_TABLE_SIZE) {
+        return std::nullopt;
+    }
+    const auto lane = lanes[static_cast<std::size_t>(fret_type)];
+    if (lane.colour == -1) {
+        return std::nullopt;
+    }
+    SightRead::Note note;
+    note.position = SightRead::Tick {position};
+    note.lengths[static_cast<std::size_t>(lane.colour)]
+        = SightRead::Tick {length};
+    note.flags = lane.flags;
+    return note;
+}
+
 std::vector<SightRead::Note> add_fifth_lane_greens(
     std::vector<SightRead::Note> notes,
     const std::vector<SightRead::Detail::NoteEvent>& note_events)
@@ -391,12 +430,13 @@ note_track_from_section(const SightRead::Detail::ChartSection& section,
     constexpr std::array<std::uint8_t, 6> DRUMS {
         {'_', 'd', 'r', 'u', 'm', 's'}};
 
+    const auto& lanes = lane_table(track_type);
     ForcingEvents forcing_events;
     std::vector<SightRead::Note> notes;
+    notes.reserve(section.note_events.size());
     for (const auto& note_event : section.note_events) {
-        const auto note
-            = note_from_note_colour(note_event.position, note_event.length,
-                                    note_event.fret, track_type);
+        const auto note = note_from_note_colour(
+            note_event.position, note_event.length, note_event.fret, lanes);
         if (note.has_value()) {
             notes.push_back(*note);
         } else {
@@ -508,7 +548,12 @@ SightRead::Detail::ChartConverter::ChartConverter(SightRead::Metadata metadata)
     , m_hopo_threshold {SightRead::HopoThresholdType::Resolution,
                         SightRead::Tick {0}}
     , m_permitted_instruments {SightRead::all_instruments()}
+    , m_permitted_difficulties {SightRead::Difficulty::Easy,
+                                SightRead::Difficulty::Medium,
+                                SightRead::Difficulty::Hard,
+                                SightRead::Difficulty::Expert}
     , m_permit_solos {true}
+    , m_thread_count {0}
 {
 }
 
@@ -528,6 +573,14 @@ SightRead::Detail::ChartConverter::permit_instruments(
     return *this;
 }
 
+SightRead::Detail::ChartConverter&
+SightRead::Detail::ChartConverter::permit_difficulties(
+    std::set<SightRead::Difficulty> permitted_difficulties)
+{
+    m_permitted_difficulties = std::move(permitted_difficulties);
+    return *this;
+}
+
 SightRead::Detail::ChartConverter&
 SightRead::Detail::ChartConverter::parse_solos(bool permit_solos)
 {
@@ -535,6 +588,28 @@ SightRead::Detail::ChartConverter::parse_solos(bool permit_solos)
     return *this;
 }
 
+SightRead::Detail::ChartConverter&
+SightRead::Detail::ChartConverter::thread_count(unsigned int thread_count)
+{
+    m_thread_count = thread_count;
+    return *this;
+}
+
+bool SightRead::Detail::ChartConverter::wants_section(
+    std::string_view name) const
+{
+    if (name == "Song" || name == "SyncTrack" || name == "Events") {
+        return true;
+    }
+    const auto pair = diff_inst_from_header(name);
+    if (!pair.has_value()) {
+        return false;
+    }
+    const auto [diff, inst] = *pair;
+    return m_permitted_difficulties.contains(diff)
+        && m_permitted_instruments.contains(inst);
+}
+
 SightRead::Song SightRead::Detail::ChartConverter::convert(
     const SightRead::Detail::Chart& chart) const
 {
@@ -545,39 +620,92 @@ SightRead::Song SightRead::Detail::ChartConverter::convert(
     song.global_data().artist(m_artist);
     song.global_data().charter(m_charter);
 
-    for (const auto& section : chart.sections) {
-        if (section.name == "Song") {
-            try {
-                const auto resolution = std::stoi(get_with_default(
-                    section.key_value_pairs, "Resolution", "192"));
-                song.global_data().resolution(resolution);
-            } catch (const std::invalid_argument&) { // NOLINT
-                // CH just ignores this kind of parsing mistake.
-                // TODO: Use from_chars instead to avoid having to use
-                // exceptions as control flow.
+    struct TrackSection {
+        const SightRead::Detail::ChartSection* section;
+        SightRead::Difficulty difficulty;
+        SightRead::Instrument instrument;
+        int resolution;
+    };
+
+    // Song, SyncTrack and Events are read in order first, each track notes
+    // the resolution as of its own section. Tracks are then converted in
+    // parallel, see below. An error here is held back until the tracks
+    // before it have had their say, so the same error wins as when
+    // converting in order.
+    std::vector<TrackSection> track_sections;
+    std::exception_ptr global_error;
+    try {
+        for (const auto& section : chart.sections) {
+            if (section.name == "Song") {
+                try {
+                    const auto resolution = std::stoi(get_with_default(
+                        section.key_value_pairs, "Resolution", "192"));
+                    song.global_data().resolution(resolution);
+                } catch (const std::invalid_argument&) { // NOLINT
+                    // CH just ignores this kind of parsing mistake.
+                    // TODO: Use from_chars instead to avoid having to use
+                    // exceptions as control flow.
+                }
+            } else if (section.name == "SyncTrack") {
+                song.global_data().tempo_map(tempo_map_from_section(
+                    section, song.global_data().resolution()));
+            } else if (section.name == "Events") {
+                song.global_data().practice_sections(
+                    practice_sections_from_section(section));
+            } else {
+                auto pair = diff_inst_from_header(section.name);
+                if (!pair.has_value()) {
+                    continue;
+                }
+                auto [diff, inst] = *pair;
+                if (!m_permitted_instruments.contains(inst)
+                    || !m_permitted_difficulties.contains(diff)) {
+                    continue;
+                }
+                track_sections.push_back(
+                    {&section, diff, inst, song.global_data().resolution()});
             }
-        } else if (section.name == "SyncTrack") {
-            song.global_data().tempo_map(tempo_map_from_section(
-                section, song.global_data().resolution()));
-        } else if (section.name == "Events") {
-            song.global_data().practice_sections(
-                practice_sections_from_section(section));
-        } else {
-            auto pair = diff_inst_from_header(section.name);
-            if (!pair.has_value()) {
-                continue;
-            }
-            auto [diff, inst] = *pair;
-            if (!m_permitted_instruments.contains(inst)) {
-                continue;
-            }
-            const auto resolution = song.global_data().resolution();
-            auto note_track = note_track_from_section(
-                section, song.global_data_ptr(),
-                track_type_from_instrument(inst), m_permit_solos,
-                m_hopo_threshold.chart_max_hopo_gap(resolution));
-            song.add_note_track(inst, diff, std::move(note_track));
         }
+    } catch (...) {
+        global_error = std::current_exception();
+    }
+
+    // A NoteTrack reads the resolution while it's built (for its base
+    // score), so tracks are converted in runs that share one with the global
+    // data set to it, as if each were converted in place. That's one run
+    // unless a [Song] section comes after a track.
+    const auto final_resolution = song.global_data().resolution();
+    const auto global_data = song.global_data_ptr();
+    std::vector<std::optional<SightRead::NoteTrack>> note_tracks(
+        track_sections.size());
+    for (auto begin = 0U; begin < track_sections.size();) {
+        const auto resolution = track_sections[begin].resolution;
+        auto end = begin + 1;
+        while (end < track_sections.size()
+               && track_sections[end].resolution == resolution) {
+            ++end;
+        }
+        global_data->resolution(resolution);
+        SightRead::Detail::parallel_for(
+            end - begin, m_thread_count, [&](auto i) {
+                const auto& track = track_sections[begin + i];
+                note_tracks[begin + i] = note_track_from_section(
+                    *track.section, global_data,
+                    track_type_from_instrument(track.instrument),
+                    m_permit_solos,
+                    m_hopo_threshold.chart_max_hopo_gap(resolution));
+            });
+        begin = end;
+    }
+    global_data->resolution(final_resolution);
+    if (global_error != nullptr) {
+        std::rethrow_exception(global_error);
+    }
+
+    for (auto i = 0U; i < track_sections.size(); ++i) {
+        song.add_note_track(track_sections[i].instrument,
+                            track_sections[i].difficulty,
+                            std::move(*note_tracks[i]));
     }
 
     if (song.instruments().empty()) {
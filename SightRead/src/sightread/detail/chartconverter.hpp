@@ -3,6 +3,7 @@
 
 #include <set>
 #include <string>
+#include <string_view>
 
 #include "sightread/detail/chart.hpp"
 #include "sightread/hopothreshold.hpp"
@@ -18,14 +19,23 @@ private:
     std::string m_charter;
     SightRead::HopoThreshold m_hopo_threshold;
     std::set<SightRead::Instrument> m_permitted_instruments;
+    std::set<SightRead::Difficulty> m_permitted_difficulties;
     bool m_permit_solos;
+    unsigned int m_thread_count;
 
 public:
     explicit ChartConverter(SightRead::Metadata metadata);
     ChartConverter& hopo_threshold(SightRead::HopoThreshold hopo_threshold);
     ChartConverter&
     permit_instruments(std::set<SightRead::Instrument> permitted_instruments);
+    ChartConverter&
+    permit_difficulties(std::set<SightRead::Difficulty> permitted_difficulties);
     ChartConverter& parse_solos(bool permit_solos);
+    // Threads used to convert instrument sections, 0 = one per hardware
+    // thread. The song is the same whatever the count.
+    ChartConverter& thread_count(unsigned int thread_count);
+    // Whether convert looks at a section with this name at all
+    [[nodiscard]] bool wants_section(std::string_view name) const;
     SightRead::Song convert(const SightRead::Detail::Chart& chart) const;
 };
 }
@@ -1,7 +1,10 @@
 #include <algorithm>
 #include <climits>
+#include <exception>
 #include <limits>
+#include <map>
 #include <string_view>
+#include <tuple>
 #include <utility>
 #include <vector>
 
@@ -1123,6 +1126,7 @@ SightRead::Detail::MidiConverter::MidiConverter(SightRead::Metadata metadata)
                         SightRead::Tick {0}}
     , m_permitted_instruments {SightRead::all_instruments()}
     , m_permit_solos {true}
+    , m_thread_count {0}
 {
 }
 
@@ -1149,6 +1153,13 @@ SightRead::Detail::MidiConverter::parse_solos(bool permit_solos)
     return *this;
 }
 
+SightRead::Detail::MidiConverter&
+SightRead::Detail::MidiConverter::thread_count(unsigned int thread_count)
+{
+    m_thread_count = thread_count;
+    return *this;
+}
+
 std::optional<SightRead::Instrument>
 SightRead::Detail::MidiConverter::midi_section_instrument(
     const std::string& track_name) const
@@ -1188,40 +1199,25 @@ SightRead::Detail::MidiConverter::midi_section_instrument(
     return std::nullopt;
 }
 
-void SightRead::Detail::MidiConverter::process_instrument_track(
-    const std::string& track_name, const SightRead::Detail::MidiTrack& track,
-    SightRead::Song& song) const
+std::map<SightRead::Difficulty, SightRead::NoteTrack>
+SightRead::Detail::MidiConverter::process_instrument_track(
+    SightRead::Instrument inst, const SightRead::Detail::MidiTrack& track,
+    std::shared_ptr<SightRead::SongGlobalData> global_data) const
 {
-    const auto inst = midi_section_instrument(track_name);
-    if (!inst.has_value()) {
-        return;
+    if (is_fortnite_instrument(inst)) {
+        return fortnite_note_tracks_from_midi(track, std::move(global_data),
+                                              m_permit_solos);
     }
-    if (is_fortnite_instrument(*inst)) {
-        auto tracks = fortnite_note_tracks_from_midi(
-            track, song.global_data_ptr(), m_permit_solos);
-        for (auto& [diff, note_track] : tracks) {
-            song.add_note_track(*inst, diff, std::move(note_track));
-        }
-    } else if (SightRead::Detail::is_six_fret_instrument(*inst)) {
-        auto tracks = ghl_note_tracks_from_midi(
-            track, song.global_data_ptr(), m_hopo_threshold, m_permit_solos);
-        for (auto& [diff, note_track] : tracks) {
-            song.add_note_track(*inst, diff, std::move(note_track));
-        }
-    } else if (*inst == SightRead::Instrument::Drums) {
-        auto tracks = drum_note_tracks_from_midi(track, song.global_data_ptr(),
-                                                 m_permit_solos);
-        for (auto& [diff, note_track] : tracks) {
-            song.add_note_track(SightRead::Instrument::Drums, diff,
-                                std::move(note_track));
-        }
-    } else {
-        auto tracks = note_tracks_from_midi(track, song.global_data_ptr(),
-                                            m_hopo_threshold, m_permit_solos);
-        for (auto& [diff, note_track] : tracks) {
-            song.add_note_track(*inst, diff, std::move(note_track));
-        }
+    if (SightRead::Detail::is_six_fret_instrument(inst)) {
+        return ghl_note_tracks_from_midi(track, std::move(global_data),
+                                         m_hopo_threshold, m_permit_solos);
     }
+    if (inst == SightRead::Instrument::Drums) {
+        return drum_note_tracks_from_midi(track, std::move(global_data),
+                                          m_permit_solos);
+    }
+    return note_tracks_from_midi(track, std::move(global_data),
+                                 m_hopo_threshold, m_permit_solos);
 }
 
 SightRead::Song SightRead::Detail::MidiConverter::convert(
@@ -1246,18 +1242,50 @@ SightRead::Song SightRead::Detail::MidiConverter::convert(
     song.global_data().tempo_map(
         read_first_midi_track(midi.tracks[0], midi.ticks_per_quarter_note));
 
-    for (const auto& track : midi.tracks) {
-        const auto track_name = midi_track_name(track);
-        if (!track_name.has_value()) {
-            continue;
+    // Instrument tracks only read the resolution, which is fixed for a midi,
+    // so they're converted in parallel and added in file order afterwards.
+    // An error in BEAT or EVENTS is held back until the tracks before it
+    // have had their say, so the same error wins as when converting in order.
+    std::vector<std::tuple<SightRead::Instrument,
+                           const SightRead::Detail::MidiTrack*>>
+        instrument_tracks;
+    std::exception_ptr global_error;
+    try {
+        for (const auto& track : midi.tracks) {
+            const auto track_name = midi_track_name(track);
+            if (!track_name.has_value()) {
+                continue;
+            }
+            if (*track_name == "BEAT") {
+                song.global_data().od_beats(od_beats_from_track(track));
+            } else if (*track_name == "EVENTS") {
+                song.global_data().practice_sections(
+                    practice_sections_from_track(track));
+            } else if (const auto inst = midi_section_instrument(*track_name);
+                       inst.has_value()) {
+                instrument_tracks.emplace_back(*inst, &track);
+            }
         }
-        if (*track_name == "BEAT") {
-            song.global_data().od_beats(od_beats_from_track(track));
-        } else if (*track_name == "EVENTS") {
-            song.global_data().practice_sections(
-                practice_sections_from_track(track));
-        } else {
-            process_instrument_track(*track_name, track, song);
+    } catch (...) {
+        global_error = std::current_exception();
+    }
+
+    const auto global_data = song.global_data_ptr();
+    std::vector<std::map<SightRead::Difficulty, SightRead::NoteTrack>>
+        note_tracks(instrument_tracks.size());
+    SightRead::Detail::parallel_for(
+        instrument_tracks.size(), m_thread_count, [&](auto i) {
+            const auto& [inst, track] = instrument_tracks[i];
+            note_tracks[i] = process_instrument_track(inst, *track, global_data);
+        });
+    if (global_error != nullptr) {
+        std::rethrow_exception(global_error);
+    }
+
+    for (auto i = 0U; i < instrument_tracks.size(); ++i) {
+        for (auto& [diff, note_track] : note_tracks[i]) {
+            song.add_note_track(std::get<0>(instrument_tracks[i]), diff,
+                                std::move(note_track));
         }
     }
 
@@ -1,6 +1,8 @@
 #ifndef SIGHTREAD_DETAIL_MIDICONVERTER_HPP
 #define SIGHTREAD_DETAIL_MIDICONVERTER_HPP
 
+#include <map>
+#include <memory>
 #include <optional>
 #include <set>
 #include <string>
@@ -20,12 +22,14 @@ private:
     SightRead::HopoThreshold m_hopo_threshold;
     std::set<SightRead::Instrument> m_permitted_instruments;
     bool m_permit_solos;
+    unsigned int m_thread_count;
 
     std::optional<SightRead::Instrument>
     midi_section_instrument(const std::string& track_name) const;
-    void process_instrument_track(const std::string& track_name,
-                                  const SightRead::Detail::MidiTrack& track,
-                                  SightRead::Song& song) const;
+    std::map<SightRead::Difficulty, SightRead::NoteTrack>
+    process_instrument_track(
+        SightRead::Instrument inst, const SightRead::Detail::MidiTrack& track,
+        std::shared_ptr<SightRead::SongGlobalData> global_data) const;
 
 public:
     explicit MidiConverter(SightRead::Metadata metadata);
@@ -33,6 +37,9 @@ public:
     MidiConverter&
     permit_instruments(std::set<SightRead::Instrument> permitted_instruments);
     MidiConverter& parse_solos(bool permit_solos);
+    // Threads used to convert instrument tracks, 0 = one per hardware
+    // thread. The song is the same whatever the count.
+    MidiConverter& thread_count(unsigned int thread_count);
     SightRead::Song convert(const SightRead::Detail::Midi& midi) const;
 };
 }
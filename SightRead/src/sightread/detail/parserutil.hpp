@@ -1,6 +1,12 @@
 #ifndef SIGHTREAD_DETAIL_PARSERUTIL_HPP
 #define SIGHTREAD_DETAIL_PARSERUTIL_HPP
 
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <system_error>
+#include <thread>
 #include <tuple>
 #include <vector>
 
@@ -22,6 +28,57 @@ form_solo_vector(const std::vector<int>& solo_on_events,
                  const std::vector<int>& solo_off_events,
                  const std::vector<SightRead::Note>& notes,
                  SightRead::TrackType track_type, bool is_midi);
+
+// Calls f(i) for each i in [0, count) on up to thread_count threads (0 = one
+// per hardware thread). Calls must be independent of each other. If any of
+// them throw, the exception from the lowest i is rethrown once all are done,
+// so errors don't depend on scheduling.
+template <typename F>
+void parallel_for(std::size_t count, unsigned int thread_count, F&& f)
+{
+    if (thread_count == 0) {
+        thread_count = std::max(1U, std::thread::hardware_concurrency());
+    }
+    const auto workers = std::min<std::size_t>(thread_count, count);
+    if (workers <= 1) {
+        for (auto i = 0U; i < count; ++i) {
+            f(i);
+        }
+        return;
+    }
+
+    std::vector<std::exception_ptr> errors(count);
+    std::atomic<std::size_t> next {0};
+    const auto work = [&] {
+        for (auto i = next++; i < count; i = next++) {
+            try {
+                f(i);
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(workers - 1);
+    try {
+        for (auto i = 1U; i < workers; ++i) {
+            threads.emplace_back(work);
+        }
+    } catch (const std::system_error&) { // NOLINT
+        // Carry on with however many threads did start.
+    }
+    work();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    for (const auto& error : errors) {
+        if (error != nullptr) {
+            std::rethrow_exception(error);
+        }
+    }
+}
 }
 
 #endif
@@ -9,6 +9,7 @@ SightRead::MidiParser::MidiParser(SightRead::Metadata metadata)
                         SightRead::Tick {0}}
     , m_permitted_instruments {SightRead::all_instruments()}
     , m_permit_solos {true}
+    , m_thread_count {0}
 {
 }
 
@@ -32,6 +33,13 @@ SightRead::MidiParser& SightRead::MidiParser::parse_solos(bool permit_solos)
     return *this;
 }
 
+SightRead::MidiParser&
+SightRead::MidiParser::thread_count(unsigned int thread_count)
+{
+    m_thread_count = thread_count;
+    return *this;
+}
+
 SightRead::Song
 SightRead::MidiParser::parse(std::span<const std::uint8_t> data) const
 {
@@ -40,6 +48,7 @@ SightRead::MidiParser::parse(std::span<const std::uint8_t> data) const
     const auto converter = SightRead::Detail::MidiConverter(m_metadata)
                                .hopo_threshold(m_hopo_threshold)
                                .permit_instruments(m_permitted_instruments)
-                               .parse_solos(m_permit_solos);
+                               .parse_solos(m_permit_solos)
+                               .thread_count(m_thread_count);
     return converter.convert(midi);
 }
@@ -173,6 +173,52 @@ void SightRead::NoteTrack::merge_same_time_notes()
     m_notes = std::move(notes);
 }
 
+void SightRead::NoteTrack::build_position_index()
+{
+    m_note_ticks.clear();
+    m_note_ticks.reserve(m_notes.size());
+    for (const auto& note : m_notes) {
+        m_note_ticks.push_back(note.position.value());
+    }
+
+    m_sp_ticks.clear();
+    m_sp_ticks.reserve(m_sp_phrases.size());
+    for (const auto& phrase : m_sp_phrases) {
+        m_sp_ticks.push_back(phrase.position.value());
+    }
+}
+
+std::span<const SightRead::Note>
+SightRead::NoteTrack::notes_in_range(SightRead::Tick start,
+                                     SightRead::Tick end) const
+{
+    if (end <= start) {
+        return {};
+    }
+    const auto first = std::lower_bound(m_note_ticks.cbegin(),
+                                        m_note_ticks.cend(), start.value());
+    const auto last
+        = std::lower_bound(first, m_note_ticks.cend(), end.value());
+    return std::span<const Note> {m_notes}.subspan(
+        static_cast<std::size_t>(first - m_note_ticks.cbegin()),
+        static_cast<std::size_t>(last - first));
+}
+
+std::span<const SightRead::StarPower>
+SightRead::NoteTrack::sp_phrases_in_range(SightRead::Tick start,
+                                          SightRead::Tick end) const
+{
+    if (end <= start) {
+        return {};
+    }
+    const auto first = std::lower_bound(m_sp_ticks.cbegin(), m_sp_ticks.cend(),
+                                        start.value());
+    const auto last = std::lower_bound(first, m_sp_ticks.cend(), end.value());
+    return std::span<const StarPower> {m_sp_phrases}.subspan(
+        static_cast<std::size_t>(first - m_sp_ticks.cbegin()),
+        static_cast<std::size_t>(last - first));
+}
+
 void SightRead::NoteTrack::add_hopos(SightRead::Tick max_hopo_gap)
 {
     if (m_track_type == TrackType::Drums) {
@@ -278,6 +324,7 @@ SightRead::NoteTrack::NoteTrack(std::vector<Note> notes,
     }
 
     add_hopos(max_hopo_gap);
+    build_position_index();
 }
 
 void SightRead::NoteTrack::generate_drum_fills(
@@ -439,5 +486,6 @@ SightRead::NoteTrack::snap_chords(SightRead::Tick snap_gap) const
         }
     }
     new_track.merge_same_time_notes();
+    new_track.build_position_index();
     return new_track;
 }
@@ -375,6 +375,26 @@ BOOST_AUTO_TEST_CASE(non_note_sections_can_be_in_any_order)
                                   expected_bpms.cbegin(), expected_bpms.cend());
 }
 
+BOOST_AUTO_TEST_CASE(tracks_use_the_resolution_as_of_their_section)
+{
+    const auto guitar_track = section_string("ExpertSingle", {{768, 0, 192}});
+    const auto bass_track = section_string("ExpertDoubleBass", {{768, 0, 192}});
+    const auto header = header_string({{"Resolution", "480"}});
+    const auto chart_file
+        = guitar_track + '\n' + header + '\n' + bass_track;
+
+    const auto song
+        = SightRead::ChartParser({}).thread_count(4).parse(chart_file);
+    const auto& guitar = song.track(SightRead::Instrument::Guitar,
+                                    SightRead::Difficulty::Expert);
+    const auto& bass = song.track(SightRead::Instrument::Bass,
+                                  SightRead::Difficulty::Expert);
+
+    BOOST_CHECK_EQUAL(song.global_data().resolution(), 480);
+    BOOST_CHECK_EQUAL(guitar.base_score(), 75);
+    BOOST_CHECK_EQUAL(bass.base_score(), 60);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 BOOST_AUTO_TEST_SUITE(only_first_nonempty_part_of_note_sections_matter)
@@ -765,6 +785,60 @@ BOOST_AUTO_TEST_CASE(instruments_not_permitted_are_dropped_from_charts)
                                   expected_instruments.cend());
 }
 
+BOOST_AUTO_TEST_CASE(first_section_wins_when_converted_in_parallel)
+{
+    const auto first_track = section_string("ExpertSingle", {{768, 1, 0}});
+    const auto drum_track = section_string("ExpertDrums", {{768, 0, 0}});
+    const auto second_track = section_string("ExpertSingle", {{768, 2, 0}});
+    const auto chart_file
+        = first_track + '\n' + drum_track + '\n' + second_track;
+
+    const auto song
+        = SightRead::ChartParser({}).thread_count(4).parse(chart_file);
+
+    BOOST_CHECK_EQUAL(
+        song.track(SightRead::Instrument::Guitar, SightRead::Difficulty::Expert)
+            .notes()[0]
+            .colours(),
+        1 << SightRead::FIVE_FRET_RED);
+    BOOST_CHECK_EQUAL(
+        song.track(SightRead::Instrument::Drums, SightRead::Difficulty::Expert)
+            .notes()[0]
+            .colours(),
+        1 << SightRead::DRUM_KICK);
+}
+
+BOOST_AUTO_TEST_CASE(difficulties_not_permitted_are_dropped_from_charts)
+{
+    const auto expert_track = section_string("ExpertSingle", {{768, 0, 0}});
+    const auto easy_track = section_string("EasySingle", {{192, 0, 0}});
+    const auto chart_file = expert_track + '\n' + easy_track;
+    const std::vector<SightRead::Difficulty> expected_difficulties {
+        SightRead::Difficulty::Expert};
+
+    const auto parser = SightRead::ChartParser({}).permit_difficulties(
+        {SightRead::Difficulty::Expert});
+    const auto song = parser.parse(chart_file);
+    const auto difficulties
+        = song.difficulties(SightRead::Instrument::Guitar);
+
+    BOOST_CHECK(difficulties == expected_difficulties);
+}
+
+BOOST_AUTO_TEST_CASE(sections_not_permitted_are_not_parsed)
+{
+    const auto guitar_track = section_string("ExpertSingle", {{768, 0, 0}});
+    const auto chart_file
+        = guitar_track + "\n[ExpertDoubleBass]\n{\n192 = N\n}\n";
+
+    const auto parser = SightRead::ChartParser({}).permit_instruments(
+        {SightRead::Instrument::Guitar});
+
+    BOOST_CHECK_NO_THROW([&] { return parser.parse(chart_file); }());
+    BOOST_CHECK_THROW([&] { return SightRead::ChartParser({}).parse(chart_file); }(),
+                      SightRead::ParseError);
+}
+
 BOOST_AUTO_TEST_CASE(solos_ignored_from_charts_if_not_permitted)
 {
     const auto chart_file = section_string(
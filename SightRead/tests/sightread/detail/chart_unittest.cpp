@@ -185,6 +185,71 @@ BOOST_AUTO_TEST_CASE(e_events_are_read)
                                   events.cend());
 }
 
+BOOST_AUTO_TEST_CASE(e_events_keep_their_spaces)
+{
+    const char* text = "[Section]\n{\n1000 = E section Big Intro\n}";
+    const std::vector<SightRead::Detail::Event> events {
+        {1000, "section Big Intro"}};
+
+    const auto section = SightRead::Detail::parse_chart(text).sections[0];
+
+    BOOST_CHECK_EQUAL_COLLECTIONS(section.events.cbegin(),
+                                  section.events.cend(), events.cbegin(),
+                                  events.cend());
+}
+
+BOOST_AUTO_TEST_CASE(extra_fields_after_a_note_are_ignored)
+{
+    const char* text = "[Section]\n{\n1000 = N 1 0 2\n}";
+    const std::vector<SightRead::Detail::NoteEvent> events {{1000, 1, 0}};
+
+    const auto section = SightRead::Detail::parse_chart(text).sections[0];
+
+    BOOST_CHECK_EQUAL_COLLECTIONS(section.note_events.cbegin(),
+                                  section.note_events.cend(), events.cbegin(),
+                                  events.cend());
+}
+
+BOOST_AUTO_TEST_CASE(crlf_lines_are_read)
+{
+    const char* text = "[Section]\r\n{\r\n1000 = N 1 0\r\n2000 = TS 3\r\n}\r\n";
+    const std::vector<SightRead::Detail::NoteEvent> notes {{1000, 1, 0}};
+    const std::vector<SightRead::Detail::TimeSigEvent> time_sigs {
+        {2000, 3, 2}};
+
+    const auto section = SightRead::Detail::parse_chart(text).sections[0];
+
+    BOOST_CHECK_EQUAL_COLLECTIONS(section.note_events.cbegin(),
+                                  section.note_events.cend(), notes.cbegin(),
+                                  notes.cend());
+    BOOST_CHECK_EQUAL_COLLECTIONS(section.ts_events.cbegin(),
+                                  section.ts_events.cend(),
+                                  time_sigs.cbegin(), time_sigs.cend());
+}
+
+BOOST_AUTO_TEST_CASE(lines_crossing_block_boundaries_are_read)
+{
+    std::string text = "[Section]\n{\n";
+    std::vector<SightRead::Detail::NoteEvent> notes;
+    for (auto i = 0; i < 100; ++i) {
+        text += "  " + std::to_string(i * 192) + " = N " + std::to_string(i % 5)
+            + " " + std::to_string(i) + "\n";
+        notes.push_back({i * 192, i % 5, i});
+    }
+    const std::string long_event = std::string(100, 'x') + " end";
+    text += "19200 = E " + long_event + "\n}";
+    const std::vector<SightRead::Detail::Event> events {{19200, long_event}};
+
+    const auto section = SightRead::Detail::parse_chart(text).sections[0];
+
+    BOOST_CHECK_EQUAL_COLLECTIONS(section.note_events.cbegin(),
+                                  section.note_events.cend(), notes.cbegin(),
+                                  notes.cend());
+    BOOST_CHECK_EQUAL_COLLECTIONS(section.events.cbegin(),
+                                  section.events.cend(), events.cbegin(),
+                                  events.cend());
+}
+
 BOOST_AUTO_TEST_CASE(other_events_are_ignored)
 {
     const char* text = "[Section]\n{\n1105 = A 133\n}";
@@ -218,3 +283,38 @@ BOOST_AUTO_TEST_CASE(short_mid_section_lines_throw)
         }(),
         SightRead::ParseError);
 }
+
+BOOST_AUTO_TEST_CASE(index_finds_section_bodies)
+{
+    const char* text = "[Song]\n{\n  Name = x\n}\n[Events]\r\n{\r\n}\r\n";
+
+    const auto index = SightRead::Detail::index_chart(text);
+
+    BOOST_CHECK_EQUAL(index.size(), 2);
+    BOOST_CHECK_EQUAL(index[0].name, "Song");
+    BOOST_CHECK_EQUAL(index[0].body, "Name = x\n");
+    BOOST_CHECK_EQUAL(index[1].name, "Events");
+    BOOST_TEST(index[1].body.empty());
+}
+
+BOOST_AUTO_TEST_CASE(braces_inside_lines_do_not_end_sections)
+{
+    const char* text = "[Events]\n{\n0 = E }\n}x\n  }\n";
+
+    const auto index = SightRead::Detail::index_chart(text);
+
+    BOOST_CHECK_EQUAL(index.size(), 1);
+    BOOST_CHECK_EQUAL(index[0].body, "0 = E }\n}x\n  ");
+}
+
+BOOST_AUTO_TEST_CASE(unwanted_sections_are_skipped)
+{
+    const char* text = "[A]\n{\n1 = N\n}\n[B]\n{\n1000 = B 150000\n}";
+
+    const auto chart = SightRead::Detail::parse_chart(
+        text, [](auto name) { return name != "A"; });
+
+    BOOST_CHECK_EQUAL(chart.sections.size(), 1);
+    BOOST_CHECK_EQUAL(chart.sections[0].name, "B");
+    BOOST_CHECK_EQUAL(chart.sections[0].bpm_events.size(), 1);
+}
@@ -281,6 +281,38 @@ BOOST_AUTO_TEST_CASE(notes_are_read_from_part_guitar)
         1 << SightRead::FIVE_FRET_RED);
 }
 
+BOOST_AUTO_TEST_CASE(first_track_wins_when_converted_in_parallel)
+{
+    SightRead::Detail::MidiTrack first_track {
+        {{0, {part_event("PART GUITAR")}},
+         {768, {SightRead::Detail::MidiEvent {0x90, {97, 64}}}},
+         {960, {SightRead::Detail::MidiEvent {0x80, {97, 0}}}}}};
+    SightRead::Detail::MidiTrack bass_track {
+        {{0, {part_event("PART BASS")}},
+         {768, {SightRead::Detail::MidiEvent {0x90, {98, 64}}}},
+         {960, {SightRead::Detail::MidiEvent {0x80, {98, 0}}}}}};
+    SightRead::Detail::MidiTrack second_track {
+        {{0, {part_event("PART GUITAR")}},
+         {768, {SightRead::Detail::MidiEvent {0x90, {96, 64}}}},
+         {960, {SightRead::Detail::MidiEvent {0x80, {96, 0}}}}}};
+    const SightRead::Detail::Midi midi {
+        192, {first_track, bass_track, second_track}};
+
+    const auto song
+        = SightRead::Detail::MidiConverter({}).thread_count(4).convert(midi);
+
+    BOOST_CHECK_EQUAL(
+        song.track(SightRead::Instrument::Guitar, SightRead::Difficulty::Expert)
+            .notes()[0]
+            .colours(),
+        1 << SightRead::FIVE_FRET_RED);
+    BOOST_CHECK_EQUAL(
+        song.track(SightRead::Instrument::Bass, SightRead::Difficulty::Expert)
+            .notes()[0]
+            .colours(),
+        1 << SightRead::FIVE_FRET_YELLOW);
+}
+
 BOOST_AUTO_TEST_CASE(part_guitar_event_need_not_be_the_first_event)
 {
     SightRead::Detail::MidiTrack note_track {
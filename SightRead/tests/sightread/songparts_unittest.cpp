@@ -577,3 +577,84 @@ BOOST_AUTO_TEST_CASE(disable_dynamics_is_correct)
     BOOST_CHECK_EQUAL_COLLECTIONS(track.notes().cbegin(), track.notes().cend(),
                                   new_notes.cbegin(), new_notes.cend());
 }
+
+BOOST_AUTO_TEST_SUITE(range_queries_are_correct)
+
+BOOST_AUTO_TEST_CASE(notes_in_range_is_half_open)
+{
+    const std::vector<SightRead::Note> notes {make_note(0), make_note(192),
+                                              make_note(384), make_note(576)};
+    const SightRead::NoteTrack track {
+        notes, {}, SightRead::TrackType::FiveFret, make_resolution(192)};
+    const auto range
+        = track.notes_in_range(SightRead::Tick {192}, SightRead::Tick {576});
+    const std::vector<SightRead::Note> required_notes {make_note(192),
+                                                       make_note(384)};
+
+    BOOST_CHECK_EQUAL_COLLECTIONS(range.begin(), range.end(),
+                                  required_notes.cbegin(),
+                                  required_notes.cend());
+    BOOST_CHECK_EQUAL(track.note_count_in_range(SightRead::Tick {192},
+                                                SightRead::Tick {576}),
+                      2);
+}
+
+BOOST_AUTO_TEST_CASE(empty_and_out_of_bounds_ranges_have_no_notes)
+{
+    const std::vector<SightRead::Note> notes {make_note(192), make_note(384)};
+    const SightRead::NoteTrack track {
+        notes, {}, SightRead::TrackType::FiveFret, make_resolution(192)};
+
+    BOOST_CHECK_EQUAL(
+        track.note_count_in_range(SightRead::Tick {200}, SightRead::Tick {300}),
+        0);
+    BOOST_CHECK_EQUAL(
+        track.note_count_in_range(SightRead::Tick {384}, SightRead::Tick {192}),
+        0);
+    BOOST_CHECK_EQUAL(
+        track.note_count_in_range(SightRead::Tick {768}, SightRead::Tick {960}),
+        0);
+    BOOST_CHECK_EQUAL(
+        track.note_count_in_range(SightRead::Tick {-100}, SightRead::Tick {1000}),
+        2);
+}
+
+BOOST_AUTO_TEST_CASE(sp_phrases_in_range_uses_phrase_start)
+{
+    const std::vector<SightRead::Note> notes {make_note(0), make_note(192),
+                                              make_note(768)};
+    const std::vector<SightRead::StarPower> phrases {
+        {SightRead::Tick {0}, SightRead::Tick {50}},
+        {SightRead::Tick {192}, SightRead::Tick {600}},
+        {SightRead::Tick {768}, SightRead::Tick {50}}};
+    const SightRead::NoteTrack track {
+        notes, phrases, SightRead::TrackType::FiveFret, make_resolution(192)};
+    const auto range = track.sp_phrases_in_range(SightRead::Tick {100},
+                                                 SightRead::Tick {768});
+    const std::vector<SightRead::StarPower> required_phrases {
+        {SightRead::Tick {192}, SightRead::Tick {600}}};
+
+    BOOST_CHECK_EQUAL_COLLECTIONS(range.begin(), range.end(),
+                                  required_phrases.cbegin(),
+                                  required_phrases.cend());
+}
+
+BOOST_AUTO_TEST_CASE(snapped_tracks_have_updated_ranges)
+{
+    const std::vector<SightRead::Note> notes {
+        make_note(0, 0, SightRead::FIVE_FRET_GREEN),
+        make_note(5, 0, SightRead::FIVE_FRET_RED),
+        make_note(480, 0, SightRead::FIVE_FRET_RED)};
+    const SightRead::NoteTrack track {
+        notes, {}, SightRead::TrackType::FiveFret, make_resolution(480)};
+    const auto new_track = track.snap_chords(SightRead::Tick {10});
+
+    BOOST_CHECK_EQUAL(
+        new_track.note_count_in_range(SightRead::Tick {0}, SightRead::Tick {10}),
+        1);
+    BOOST_CHECK_EQUAL(new_track.note_count_in_range(SightRead::Tick {0},
+                                                    SightRead::Tick {481}),
+                      2);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,175 @@
+#ifndef AUDIO_ENGINE_HPP
+#define AUDIO_ENGINE_HPP
+
+#include "loop_plan.hpp"
+#include "mapped_file.hpp"
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <stop_token>
+#include <string>
+#include <vector>
+
+namespace NoteGen {
+
+// Decoded audio, interleaved 32-bit float samples. They're either owned or
+// live in a mapped cache file (see PcmCache), data() is whichever is set.
+struct PcmAudio {
+    int sample_rate = 0;
+    int channels = 0;
+    std::vector<float> samples;
+
+    std::shared_ptr<const MappedFile> mapped;
+    const float* mapped_samples = nullptr;
+    size_t mapped_count = 0;
+
+    const float* data() const { return mapped ? mapped_samples : samples.data(); }
+    size_t sample_count() const { return mapped ? mapped_count : samples.size(); }
+    size_t frames() const { return channels > 0 ? sample_count() / channels : 0; }
+
+    // drop the samples, owned or mapped
+    void release() {
+        samples.clear();
+        samples.shrink_to_fit();
+        mapped.reset();
+        mapped_samples = nullptr;
+        mapped_count = 0;
+    }
+};
+
+// done/total are seconds of output audio
+using AudioProgress = std::function<void(double done_seconds, double total_seconds)>;
+
+// Thrown when an audio job's stop_token asks it to stop
+class AudioCancelled : public std::runtime_error {
+public:
+    AudioCancelled() : std::runtime_error("Cancelled") {}
+};
+
+// Called with consecutive blocks of the output, frames * channels samples each
+using PcmSink = std::function<void(const float* samples, size_t frames)>;
+
+// Decode any file ffmpeg can read, once, at its own channel count and at
+// sample_rate (0 = the file's own rate). Throws std::runtime_error if ffmpeg
+// fails or the output can't be read.
+PcmAudio decode_audio(const std::string& ffmpeg_path, const std::string& source_path,
+                      std::stop_token stop = {}, int sample_rate = 0);
+
+// Frames in the looped output, segments are clamped to the end of the source
+size_t timeline_frames(const PcmAudio& source, const AudioTimeline& timeline);
+
+// Copy each segment's sample range into the output in timeline order, a block
+// at a time. Repeats replay the same source range, nothing is rendered
+// twice. Where a segment doesn't carry on from the one before it in the
+// source, the first few ms are crossfaded (equal power) with what would have
+// played next, so seams don't click. fade_out fades the last second to
+// silence.
+void render_timeline(const PcmAudio& source,
+                     const AudioTimeline& timeline,
+                     bool fade_out,
+                     const PcmSink& sink);
+
+// A run of whole segments cut from a longer timeline, and where it sits in
+// the whole output
+struct TimelinePiece {
+    AudioTimeline timeline;
+    std::optional<AudioSegment> previous;  // played just before, none for the first piece
+    size_t frame_offset = 0;               // output frames before the piece
+    size_t total_frames = 0;               // frames in the whole output
+};
+
+// Cut the timeline into up to pieces roughly equal runs of whole segments,
+// joins land on segment seams
+std::vector<TimelinePiece> split_timeline(const PcmAudio& source, const AudioTimeline& timeline, size_t pieces);
+
+// Render one piece as it plays in the whole output: the seam into it is
+// crossfaded and fade_out fades the last second of the whole output, even
+// where that starts in an earlier piece. The pieces rendered one after
+// another give exactly the samples of render_timeline.
+void render_piece(const PcmAudio& source,
+                  const TimelinePiece& piece,
+                  bool fade_out,
+                  const PcmSink& sink);
+
+// Render the timeline straight into ffmpeg, the codec comes from
+// dest_path's extension. Wav and flac outputs of a few minutes or more are
+// cut into chunks at segment seams, encoded on up to chunk_jobs encoders at
+// once (0 = one per hardware thread) and stream copied back into one file.
+// Lossy formats are always encoded in one go, their priming would pile up
+// at the joins.
+// progress may then be called from several threads, one at a time.
+// Throws std::runtime_error on failure.
+void encode_timeline(const std::string& ffmpeg_path,
+                     const PcmAudio& source,
+                     const AudioTimeline& timeline,
+                     bool fade_out,
+                     const std::string& dest_path,
+                     const AudioProgress& progress = nullptr,
+                     std::stop_token stop = {},
+                     unsigned chunk_jobs = 1);
+
+// Lay the stems side by side as one wide stream (stem 0's channels first),
+// shorter stems are padded with silence. Stems must share a sample rate,
+// their samples are released as they're copied.
+PcmAudio interleave_stems(std::vector<PcmAudio>& stems);
+
+// Splice every stem with the same timeline in one pass and write all the
+// outputs from a single ffmpeg (per chunk, see encode_timeline),
+// dest_paths[i] gets stems[i]. Throws std::runtime_error on failure, every
+// output is suspect then.
+void encode_stems(const std::string& ffmpeg_path,
+                  std::vector<PcmAudio> stems,
+                  const AudioTimeline& timeline,
+                  bool fade_out,
+                  const std::vector<std::string>& dest_paths,
+                  const AudioProgress& progress = nullptr,
+                  std::stop_token stop = {},
+                  unsigned chunk_jobs = 1);
+
+// Encode each distinct segment of the timeline once, padded with a little
+// of the audio around it, into a sheet next to dest_path, then stream copy
+// the output together from the sheet (see stream_copy_timeline). Encoding
+// follows the unique sections instead of the output length. With fade_out
+// the last second is encoded on its own. Returns false without writing
+// anything when the timeline repeats too little for this to pay off.
+// Throws std::runtime_error on failure.
+bool encode_sections(const std::string& ffmpeg_path,
+                     const PcmAudio& source,
+                     const AudioTimeline& timeline,
+                     bool fade_out,
+                     const std::string& dest_path,
+                     const AudioProgress& progress = nullptr,
+                     std::stop_token stop = {});
+
+// Packet start times (seconds) of the first audio stream, plus the end of the
+// last packet. These are the only points stream copy can cut at.
+std::vector<double> probe_packet_boundaries(const std::string& ffmpeg_path, const std::string& source_path);
+
+// A packet aligned [in, out) range of the source
+struct CopyRange {
+    double in_seconds;
+    double out_seconds;
+};
+
+// Snap every segment repeat to packet boundaries. Each end is picked so the
+// running output length stays as close as possible to the exact timeline, so
+// rounding never builds up into drift against the chart.
+std::vector<CopyRange> snap_to_packets(const std::vector<double>& boundaries,
+                                       const AudioTimeline& timeline);
+
+// Loop the audio by copying compressed packets through ffmpeg's concat
+// demuxer, nothing is decoded or re-encoded. Seams land on packet boundaries
+// (a few ms off the exact cut) and can't fade, so this is opt-in and not
+// used for full song loops. Throws std::runtime_error on failure.
+void stream_copy_timeline(const std::string& ffmpeg_path,
+                          const std::string& source_path,
+                          const AudioTimeline& timeline,
+                          const std::string& dest_path,
+                          const AudioProgress& progress = nullptr,
+                          std::stop_token stop = {});
+
+} // namespace NoteGen
+
+#endif // AUDIO_ENGINE_HPP
@@ -0,0 +1,77 @@
+#ifndef AUDIO_JOBS_HPP
+#define AUDIO_JOBS_HPP
+
+#include "audio_engine.hpp"
+#include "pcm_cache.hpp"
+#include <atomic>
+#include <cstddef>
+#include <stop_token>
+#include <string>
+#include <vector>
+
+namespace NoteGen {
+
+// True for the audio files a chart folder's stems can be (.ogg, .opus, .mp3, .wav)
+bool is_audio_file(const std::string& path);
+
+// One audio file of the chart folder and where its loop goes
+struct StemJob {
+    std::string source_path;
+    std::string dest_path;
+};
+
+struct StemOptions {
+    bool fade_out = false;      // full song mode
+    bool stream_copy = false;   // try copying packets, then encoding each section once, before re-encoding
+    bool shared_encode = true;  // one ffmpeg writes every stem, see process_stems
+    unsigned max_jobs = 0;      // decodes/stems/encoders in flight at once, 0 = one per hardware thread
+    PcmCache* cache = nullptr;  // decoded stems are reused from here when set
+};
+
+enum class StemState { Queued, Working, Done, Failed, Cancelled };
+
+struct StemResult {
+    StemState state = StemState::Queued;
+    std::string error;          // why it failed
+};
+
+// Live progress of a batch of stems. Workers write their own slot, any
+// thread can read it while the batch runs.
+class StemProgress {
+public:
+    explicit StemProgress(size_t stem_count)
+        : m_fractions(stem_count)
+        , m_states(stem_count) {}
+
+    size_t size() const { return m_fractions.size(); }
+    double fraction(size_t stem) const { return m_fractions[stem].load(std::memory_order_relaxed); }
+    StemState state(size_t stem) const { return m_states[stem].load(std::memory_order_relaxed); }
+
+    // every stem counts the same, they all loop the same timeline
+    double total_fraction() const;
+    size_t finished() const;
+
+    void set_fraction(size_t stem, double fraction) { m_fractions[stem].store(fraction, std::memory_order_relaxed); }
+    void set_state(size_t stem, StemState state) { m_states[stem].store(state, std::memory_order_relaxed); }
+
+private:
+    std::vector<std::atomic<double>> m_fractions;
+    std::vector<std::atomic<StemState>> m_states;
+};
+
+// Loop every stem to the same timeline. With shared_encode the stems are
+// decoded on a bounded pool and spliced together into a single ffmpeg that
+// writes every output, otherwise (or if that fails) each stem is its own
+// decode and encode on the pool. Blocks until all stems are done or
+// cancelled, results are in stem order. A stop request skips queued stems
+// and stops running ones, their partial outputs are removed.
+std::vector<StemResult> process_stems(const std::string& ffmpeg_path,
+                                      const std::vector<StemJob>& stems,
+                                      const AudioTimeline& timeline,
+                                      const StemOptions& options,
+                                      StemProgress& progress,
+                                      std::stop_token stop = {});
+
+} // namespace NoteGen
+
+#endif // AUDIO_JOBS_HPP
@@ -7,9 +7,25 @@
 #include <string>
 #include <vector>
 #include <ostream>
+#include <optional>
+#include <map>
+#include <cstdint>
 
 namespace NoteGen {
 
+class LoopPlan;
+class ChartOutput;
+
+// A loop unit's note track lines serialized once. ticks are relative to the
+// step the template was recorded from, text holds what follows the tick on
+// each line, line i being text[line_begin[i], line_begin[i + 1]).
+struct SectionTemplate {
+    std::vector<int64_t> ticks;
+    std::vector<uint32_t> line_begin;
+    std::string text;
+    bool built = false;
+};
+
 struct ChartMetadata {
     std::string name;
     std::string artist;
@@ -35,10 +51,41 @@ struct SyncTrackEvent {
     int ts_denom = 4;
 };
 
+// Builds a position-ordered sync track. Events must be added in
+// non-decreasing position order, which lets every check look only at the
+// last event of each kind: a second event of the same kind at the same tick
+// is ignored, and bpms/time sigs that don't change anything are dropped
+// (a repeated time sig is kept if it restarts the bar off a measure line).
+class SyncTrackBuilder {
+public:
+    explicit SyncTrackBuilder(int resolution = 192) : m_resolution(resolution) {}
+
+    void add(const SyncTrackEvent& event);
+    void add_bpm(SightRead::Tick position, int64_t bpm);
+    void add_time_sig(SightRead::Tick position, int numerator, int denominator);
+
+    size_t size() const { return m_events.size(); }
+    const std::vector<SyncTrackEvent>& events() const { return m_events; }
+    std::vector<SyncTrackEvent> take() { return std::move(m_events); }
+
+private:
+    int m_resolution;
+    std::vector<SyncTrackEvent> m_events;
+    std::optional<SyncTrackEvent> m_last_bpm;
+    std::optional<SyncTrackEvent> m_last_ts;
+};
+
+// Writes .chart text through a reusable output buffer, lines are formatted
+// with std::to_chars and flushed to the stream/fd in large chunks. Keep one
+// writer around when writing several charts so the buffers are reused.
 class ChartWriter {
 public:
     ChartWriter() = default;
 
+    // Worker threads for large note tracks, 0 = one per hardware thread and
+    // 1 = always write on the calling thread. Output is the same either way.
+    void set_thread_count(unsigned count) { m_thread_count = count; }
+
     // Write a complete chart file
     void write(std::ostream& out, 
                const ChartMetadata& metadata,
@@ -48,14 +95,66 @@ public:
                              std::vector<SightRead::Note>>& tracks,
                const std::vector<SightRead::StarPower>& sp_phrases);
 
+    // Write a single track chart straight from a loop plan, the looped notes
+    // are generated while writing instead of being collected first
+    void write(std::ostream& out,
+               const ChartMetadata& metadata,
+               const std::vector<SyncTrackEvent>& sync_events,
+               const std::vector<LoopedSection>& sections,
+               SightRead::Instrument instrument,
+               SightRead::Difficulty difficulty,
+               const LoopPlan& plan);
+
+    // Same, written to a file descriptor. Throws std::runtime_error if a write fails
+    void write(int fd,
+               const ChartMetadata& metadata,
+               const std::vector<SyncTrackEvent>& sync_events,
+               const std::vector<LoopedSection>& sections,
+               SightRead::Instrument instrument,
+               SightRead::Difficulty difficulty,
+               const LoopPlan& plan);
+
 private:
-    void write_song_section(std::ostream& out, const ChartMetadata& metadata);
-    void write_sync_track(std::ostream& out, const std::vector<SyncTrackEvent>& sync_events);
-    void write_events(std::ostream& out, const std::vector<LoopedSection>& sections);
-    void write_note_track(std::ostream& out, 
+    // one line of an unordered note track, "tick = type value length"
+    struct TrackEvent {
+        int64_t tick;
+        int order;  // 0=note, 1=sp (notes first at same tick)
+        char type;  // 'N' or 'S'
+        int value;  // fret, or 2 for sp
+        int64_t length;
+    };
+
+    std::vector<char> m_buffer;
+    std::vector<SectionTemplate> m_templates;  // two per plan unit, plain and hopo fixed
+    std::vector<std::string> m_chunks;         // per chunk text for parallel writes
+    unsigned m_thread_count = 0;
+    std::vector<TrackEvent> m_events;        // only used for unordered input
+    std::vector<TrackEvent> m_sort_scratch;
+
+    void write_plan(ChartOutput& out,
+                    const ChartMetadata& metadata,
+                    const std::vector<SyncTrackEvent>& sync_events,
+                    const std::vector<LoopedSection>& sections,
+                    SightRead::Instrument instrument,
+                    SightRead::Difficulty difficulty,
+                    const LoopPlan& plan);
+    void write_song_section(ChartOutput& out, const ChartMetadata& metadata);
+    // sync_events must already be in position order (see SyncTrackBuilder)
+    void write_sync_track(ChartOutput& out, const std::vector<SyncTrackEvent>& sync_events);
+    void write_events(ChartOutput& out, const std::vector<LoopedSection>& sections);
+    void write_note_track(ChartOutput& out, 
                           const std::string& track_name,
                           const std::vector<SightRead::Note>& notes,
                           const std::vector<SightRead::StarPower>& sp_phrases);
+    void write_note_track(ChartOutput& out,
+                          const std::string& track_name,
+                          const LoopPlan& plan);
+    void build_templates(const LoopPlan& plan);
+    void write_steps_parallel(ChartOutput& out, const LoopPlan& plan, unsigned threads);
+    // fallback for tracks that aren't in tick order
+    void write_unordered_events(ChartOutput& out,
+                                const std::vector<SightRead::Note>& notes,
+                                const std::vector<SightRead::StarPower>& sp_phrases);
 
     std::string instrument_difficulty_to_track_name(SightRead::Instrument inst, 
                                                      SightRead::Difficulty diff);
@@ -0,0 +1,37 @@
+#ifndef FILE_SOURCE_HPP
+#define FILE_SOURCE_HPP
+
+#include "mapped_file.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+
+namespace NoteGen {
+
+// A whole file's bytes for the parsers, memory mapped so nothing is copied,
+// or read into memory if the file can't be mapped. Throws
+// std::runtime_error if it can't be read either way.
+class FileSource {
+public:
+    explicit FileSource(const std::string& path);
+
+    // everything, as is
+    std::span<const std::uint8_t> bytes() const {
+        return {reinterpret_cast<const std::uint8_t*>(m_data.data()), m_data.size()};
+    }
+
+    // the file as text, past a utf8 bom if there is one
+    std::string_view text() const;
+
+private:
+    std::unique_ptr<MappedFile> m_mapped;
+    std::string m_buffer;
+    std::string_view m_data;
+};
+
+} // namespace NoteGen
+
+#endif // FILE_SOURCE_HPP
@@ -0,0 +1,46 @@
+#ifndef JOB_POOL_HPP
+#define JOB_POOL_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace NoteGen {
+
+// Fixed-size worker pool. Jobs may submit more jobs; wait() returns once
+// the queue is empty and every worker is idle.
+class JobPool {
+public:
+    // 0 = one worker per hardware thread
+    explicit JobPool(unsigned thread_count = 0);
+    ~JobPool();
+
+    JobPool(const JobPool&) = delete;
+    JobPool& operator=(const JobPool&) = delete;
+
+    void submit(std::function<void()> job);
+
+    // Block until all submitted jobs (and jobs they submitted) have finished
+    void wait();
+
+    unsigned size() const { return static_cast<unsigned>(m_workers.size()); }
+
+private:
+    void worker_loop();
+
+    std::vector<std::thread> m_workers;
+    std::deque<std::function<void()>> m_jobs;
+    std::mutex m_mutex;
+    std::condition_variable m_job_ready;
+    std::condition_variable m_idle;
+    size_t m_active = 0;
+    bool m_stopping = false;
+};
+
+} // namespace NoteGen
+
+#endif // JOB_POOL_HPP
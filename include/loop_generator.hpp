@@ -5,6 +5,8 @@
 #include <sightread/songparts.hpp>
 #include "chart_writer.hpp"
 #include "ini_parser.hpp"
+#include "loop_plan.hpp"
+#include <memory>
 #include <vector>
 #include <string>
 #include <optional>
@@ -28,7 +30,6 @@ struct GenerationConfig {
 struct GenerationResult {
     bool success = false;
     std::string error_message;
-    std::string chart_data;
     std::vector<LoopedSection> looped_sections;
     std::vector<SyncTrackEvent> sync_events;
     int total_notes = 0;
@@ -37,15 +38,20 @@ struct GenerationResult {
     std::string folder_name;    // For ZIP filename
     std::string chart_name;     // For song.ini
     
-    // Audio timing info for FFmpeg
-    struct AudioSegment {
-        double start_seconds;
-        double duration_seconds;
-        int repeat_count;
-    };
-    std::vector<AudioSegment> audio_segments;
+    // Everything write_chart needs, the chart text itself is never kept.
+    // The plan points into the source song so it must outlive the result.
+    ChartMetadata metadata;
+    SightRead::Instrument instrument = SightRead::Instrument::Guitar;
+    SightRead::Difficulty difficulty = SightRead::Difficulty::Expert;
+    LoopPlan plan;
+    
+    using AudioSegment = NoteGen::AudioSegment;
+    AudioTimeline audio_timeline;
 };
 
+// Stream the .chart for a successful result (no bom)
+void write_chart(std::ostream& out, const GenerationResult& result, ChartWriter& writer);
+
 class LoopGenerator {
 public:
     explicit LoopGenerator(const SightRead::Song& song, 
@@ -62,6 +68,12 @@ public:
     // Generate a looped chart
     GenerationResult generate(const GenerationConfig& config);
 
+    // Generate one looped chart per target, all sharing the same loop units.
+    // config.target_note_count is ignored, results are in ascending target
+    // order with duplicates removed.
+    std::vector<GenerationResult> generate(const GenerationConfig& config,
+                                           std::vector<int> target_note_counts);
+
 private:
     const SightRead::Song& m_song;
     SightRead::Instrument m_instrument;
@@ -75,15 +87,17 @@ private:
     // Get the end tick for a section (start of next section or end of song)
     SightRead::Tick get_section_end(size_t section_index) const;
     
-    // Generate notes by looping sections
-    std::vector<SightRead::Note> generate_looped_notes(
-        const std::vector<SectionInfo>& sections_to_loop,
-        int target_notes,
-        std::vector<LoopedSection>& out_looped_sections,
-        std::vector<GenerationResult::AudioSegment>& out_audio_segments,
-        std::vector<SyncTrackEvent>& out_sync_events,
-        std::vector<SightRead::StarPower>& out_sp_phrases,
-        bool is_full_song);
+    // Tempo map events in [start, end), in position order, relative to origin
+    void append_tempo_events(SightRead::Tick start, SightRead::Tick end,
+                             SightRead::Tick origin,
+                             std::vector<SyncTrackEvent>& out_events) const;
+    
+    // Per-unit notes, sync events, markers and audio timing
+    std::vector<LoopUnit> build_loop_units(const std::vector<SectionInfo>& sections_to_loop,
+                                           bool is_full_song) const;
+    
+    // Steps up to target_notes over the shared units, the last one cut short if needed
+    LoopPlan plan_loop(std::shared_ptr<const std::vector<LoopUnit>> units, int target_notes) const;
 };
 
 } // namespace NoteGen
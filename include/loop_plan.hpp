@@ -0,0 +1,124 @@
+#ifndef LOOP_PLAN_HPP
+#define LOOP_PLAN_HPP
+
+#include <sightread/songparts.hpp>
+#include "chart_writer.hpp"
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace NoteGen {
+
+// Audio timing info for FFmpeg
+struct AudioSegment {
+    double start_seconds;
+    double duration_seconds;
+    int repeat_count;
+};
+
+// A run of segments played back to back, repeat_count times over
+struct AudioBlock {
+    std::vector<AudioSegment> segments;
+    int repeat_count = 1;
+};
+
+// The looped audio folded into blocks, normally one block for the whole
+// passes and one for the cut short tail however long the loop runs
+using AudioTimeline = std::vector<AudioBlock>;
+
+// f(const AudioSegment&) once for every segment played, repeats expanded, in order
+template <typename F>
+void for_each_segment(const AudioTimeline& timeline, F&& f) {
+    for (const auto& block : timeline) {
+        for (int pass = 0; pass < block.repeat_count; ++pass) {
+            for (const auto& seg : block.segments) {
+                for (int repeat = 0; repeat < seg.repeat_count; ++repeat) {
+                    f(seg);
+                }
+            }
+        }
+    }
+}
+
+// A source range copied once per pass: a selected section, or the whole song
+// in full song mode. Everything here is fixed, so it's worked out once.
+struct LoopUnit {
+    SightRead::Tick source_start{0};
+    SightRead::Tick source_end{0};
+    std::span<const SightRead::Note> notes;
+    std::span<const SightRead::StarPower> sp_phrases;
+
+    // positions relative to source_start, names without the pass number
+    std::vector<SyncTrackEvent> sync_events;
+    std::vector<LoopedSection> markers;
+
+    double audio_start_seconds = 0.0;
+    double audio_duration_seconds = 0.0;
+    bool fix_first_hopo = false;   // first note hopo -> tap on the first pass
+};
+
+// One emitted section (or full pass in full song mode) of the loop plan
+struct LoopStep {
+    size_t unit_index = 0;
+    int pass = 1;
+    size_t notes_begin = 0;
+    size_t emit_count = 0;         // notes copied, less than the unit on the last step
+    SightRead::Tick loop_offset{0};
+    bool fix_first_hopo = false;
+    double audio_duration_seconds = 0.0;
+};
+
+// The looped chart as a list of steps over shared units. Notes are produced
+// on the fly when iterated, so size is proportional to the section count
+// rather than the output note count. Units point into the song's note track,
+// so a plan must not outlive the song it was built from.
+class LoopPlan {
+public:
+    LoopPlan() = default;
+    LoopPlan(std::shared_ptr<const std::vector<LoopUnit>> units, std::vector<LoopStep> steps);
+
+    bool empty() const { return m_steps.empty(); }
+    size_t note_count() const;
+    const std::vector<LoopStep>& steps() const { return m_steps; }
+    size_t unit_count() const { return m_units ? m_units->size() : 0; }
+    const LoopUnit& unit(const LoopStep& step) const { return (*m_units)[step.unit_index]; }
+
+    std::vector<SyncTrackEvent> sync_events(int resolution) const;
+    std::vector<LoopedSection> looped_sections() const;
+    AudioTimeline audio_timeline() const;
+
+    // i-th emitted note of a step, moved to its looped position
+    SightRead::Note note_at(const LoopStep& step, size_t i) const {
+        const auto& source = unit(step);
+        SightRead::Note note = source.notes[i];
+        note.position = SightRead::Tick(note.position.value() + step.loop_offset.value()
+                                        - source.source_start.value());
+
+        // if first note of section and its a hopo, make it a tap
+        if (i == 0 && step.fix_first_hopo && (note.flags & SightRead::FLAGS_HOPO)) {
+            note.flags = static_cast<SightRead::NoteFlags>(
+                (note.flags & ~SightRead::FLAGS_HOPO) | SightRead::FLAGS_TAP
+            );
+        }
+        return note;
+    }
+
+    // i-th sp phrase of a step, moved to its looped position. Every phrase of
+    // the unit is kept even when the step's notes are cut short.
+    SightRead::StarPower sp_at(const LoopStep& step, size_t i) const {
+        const auto& source = unit(step);
+        const auto& sp = source.sp_phrases[i];
+        return {SightRead::Tick(sp.position.value() + step.loop_offset.value()
+                                - source.source_start.value()),
+                sp.length};
+    }
+
+private:
+    std::shared_ptr<const std::vector<LoopUnit>> m_units;
+    std::vector<LoopStep> m_steps;
+};
+
+} // namespace NoteGen
+
+#endif // LOOP_PLAN_HPP
@@ -0,0 +1,40 @@
+#ifndef PCM_CACHE_HPP
+#define PCM_CACHE_HPP
+
+#include "audio_engine.hpp"
+#include <cstdint>
+#include <mutex>
+#include <stop_token>
+#include <string>
+
+namespace NoteGen {
+
+// On-disk cache of decoded stems keyed by a hash of the source file's
+// content, so regenerating the same song skips the decode. Entries are raw
+// float samples that get memory mapped back in. Once the cache grows past
+// max_bytes the least recently used entries are deleted. Safe to share
+// between threads; a cache that can't be written just decodes every time.
+class PcmCache {
+public:
+    PcmCache(std::string directory, uint64_t max_bytes);
+
+    // decode_audio() through the cache
+    PcmAudio decode(const std::string& ffmpeg_path, const std::string& source_path,
+                    std::stop_token stop = {}, int sample_rate = 0);
+
+    const std::string& directory() const { return m_directory; }
+
+private:
+    std::string entry_path(const std::string& source_path, int sample_rate) const;
+    bool load(const std::string& path, PcmAudio& audio) const;
+    void store(const std::string& path, const PcmAudio& audio);
+    void evict();
+
+    std::string m_directory;
+    uint64_t m_max_bytes;
+    std::mutex m_mutex;
+};
+
+} // namespace NoteGen
+
+#endif // PCM_CACHE_HPP
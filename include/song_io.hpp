@@ -0,0 +1,43 @@
+#ifndef SONG_IO_HPP
+#define SONG_IO_HPP
+
+#include <sightread/song.hpp>
+#include "ini_parser.hpp"
+#include "loop_generator.hpp"
+#include <memory>
+#include <set>
+#include <string>
+
+namespace NoteGen {
+
+// Read a whole file, stripping a utf8 bom if present
+std::string read_file_content(const std::string& path);
+
+// Parse a .chart/.mid/.midi file, throws on unknown format or parse errors.
+// Only the given instruments and difficulties are kept (empty = all), a
+// .chart skips parsing the other tracks entirely. Tracks are converted on up
+// to parse_threads threads (0 = one per hardware thread)
+std::unique_ptr<SightRead::Song> load_song(const std::string& path,
+                                           const std::set<SightRead::Instrument>& instruments = {},
+                                           const std::set<SightRead::Difficulty>& difficulties = {},
+                                           unsigned parse_threads = 0);
+
+// True for the chart formats load_song understands
+bool is_chart_file(const std::string& path);
+
+SightRead::Instrument string_to_instrument(const std::string& str);
+SightRead::Difficulty string_to_difficulty(const std::string& str);
+std::string instrument_to_string(SightRead::Instrument instrument);
+std::string difficulty_to_string(SightRead::Difficulty difficulty);
+
+// Write notes.chart (with utf8 bom) and song.ini for a generation result.
+// writer_threads is passed to ChartWriter::set_thread_count
+void write_generated_chart(const std::string& output_dir,
+                           const GenerationResult& result,
+                           const SightRead::Song& song,
+                           const SongIniData& ini_data,
+                           unsigned writer_threads = 0);
+
+} // namespace NoteGen
+
+#endif // SONG_IO_HPP
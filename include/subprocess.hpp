@@ -0,0 +1,56 @@
+#ifndef SUBPROCESS_HPP
+#define SUBPROCESS_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace NoteGen {
+
+// Child process with optional pipes to its stdin and stdout. stdin is empty
+// when it isn't piped, stderr goes wherever ours goes. Throws
+// std::runtime_error if the process can't be started.
+class Subprocess {
+public:
+    Subprocess(const std::vector<std::string>& args, bool pipe_stdin, bool pipe_stdout);
+    ~Subprocess();
+
+    Subprocess(const Subprocess&) = delete;
+    Subprocess& operator=(const Subprocess&) = delete;
+
+    // Read up to size bytes of the child's stdout, 0 once it's closed
+    size_t read(char* data, size_t size);
+
+    // Write everything to the child's stdin, false if the child closed it
+    bool write(const char* data, size_t size);
+
+    // Send eof to the child
+    void close_stdin();
+
+    // Close our pipe ends and wait for the child, returns its exit code
+    // (-1 if it didn't exit normally)
+    int wait();
+
+    // Stop the child now, for when it isn't reading or writing a pipe that
+    // closing would stop it with. wait() still has to be called.
+    void terminate();
+
+private:
+    void close_stdout();
+
+#ifdef _WIN32
+    void* m_process = nullptr;
+    void* m_stdin = nullptr;
+    void* m_stdout = nullptr;
+#else
+    int m_pid = -1;
+    int m_stdin = -1;
+    int m_stdout = -1;
+#endif
+    bool m_waited = false;
+    int m_exit_code = -1;
+};
+
+} // namespace NoteGen
+
+#endif // SUBPROCESS_HPP
@@ -0,0 +1,1034 @@
+#include "audio_engine.hpp"
+#include "job_pool.hpp"
+#include "subprocess.hpp"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <tuple>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace NoteGen {
+
+namespace {
+
+// frames per sink call, also how often progress is reported
+constexpr size_t BLOCK_FRAMES = 16384;
+
+// equal power crossfade at segments that don't follow on in the source,
+// short enough to not smear a transient
+constexpr double SEAM_SECONDS = 0.005;
+constexpr size_t NO_CARRY = static_cast<size_t>(-1);
+
+// gains for a seam of the given length, one per sample so the mix below
+// doesn't care about the channel layout
+void seam_gains(size_t seam_frames, size_t channels, std::vector<float>& gain_in, std::vector<float>& gain_out) {
+    gain_in.resize(seam_frames * channels);
+    gain_out.resize(seam_frames * channels);
+    const double quarter = std::acos(0.0);
+    for (size_t i = 0; i < seam_frames; ++i) {
+        double t = (i + 0.5) / seam_frames * quarter;
+        for (size_t c = 0; c < channels; ++c) {
+            gain_in[i * channels + c] = static_cast<float>(std::sin(t));
+            gain_out[i * channels + c] = static_cast<float>(std::cos(t));
+        }
+    }
+}
+
+// out = a * gain_a + b * gain_b, count samples
+void mix_seam(float* out, const float* a, const float* gain_a, const float* b, const float* gain_b, size_t count) {
+    size_t i = 0;
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+    for (; i + 4 <= count; i += 4) {
+        __m128 mixed = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(gain_a + i)),
+                                  _mm_mul_ps(_mm_loadu_ps(b + i), _mm_loadu_ps(gain_b + i)));
+        _mm_storeu_ps(out + i, mixed);
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 4 <= count; i += 4) {
+        float32x4_t mixed = vmulq_f32(vld1q_f32(a + i), vld1q_f32(gain_a + i));
+        mixed = vmlaq_f32(mixed, vld1q_f32(b + i), vld1q_f32(gain_b + i));
+        vst1q_f32(out + i, mixed);
+    }
+#endif
+    for (; i < count; ++i) {
+        out[i] = a[i] * gain_a[i] + b[i] * gain_b[i];
+    }
+}
+
+// read exactly size bytes, false if the stream ended first
+bool read_exact(Subprocess& process, char* data, size_t size) {
+    while (size > 0) {
+        size_t got = process.read(data, size);
+        if (got == 0) return false;
+        data += got;
+        size -= got;
+    }
+    return true;
+}
+
+uint16_t read_u16(const char* data) {
+    return static_cast<uint16_t>(static_cast<unsigned char>(data[0]) |
+                                 (static_cast<unsigned char>(data[1]) << 8));
+}
+
+uint32_t read_u32(const char* data) {
+    return static_cast<uint32_t>(read_u16(data)) | (static_cast<uint32_t>(read_u16(data + 2)) << 16);
+}
+
+// skip the riff header up to the start of the sample data, filling in the format.
+// ffmpeg can't seek back on a pipe so the data chunk size is junk, it runs to eof
+void read_wav_header(Subprocess& process, PcmAudio& audio) {
+    char riff[12];
+    if (!read_exact(process, riff, sizeof(riff)) ||
+        std::memcmp(riff, "RIFF", 4) != 0 || std::memcmp(riff + 8, "WAVE", 4) != 0) {
+        throw std::runtime_error("FFmpeg didn't produce a wav stream");
+    }
+
+    bool have_format = false;
+    while (true) {
+        char chunk[8];
+        if (!read_exact(process, chunk, sizeof(chunk))) {
+            throw std::runtime_error("Decoded audio has no data chunk");
+        }
+        uint32_t chunk_size = read_u32(chunk + 4);
+
+        if (std::memcmp(chunk, "data", 4) == 0) {
+            if (!have_format) {
+                throw std::runtime_error("Decoded audio has no format chunk");
+            }
+            return;
+        }
+
+        // chunks are padded to an even size
+        std::vector<char> body(chunk_size + (chunk_size & 1));
+        if (!read_exact(process, body.data(), body.size())) {
+            throw std::runtime_error("Decoded audio is truncated");
+        }
+
+        if (std::memcmp(chunk, "fmt ", 4) == 0 && chunk_size >= 16) {
+            uint16_t format = read_u16(body.data());
+            if (format == 0xFFFE && chunk_size >= 26) {
+                format = read_u16(body.data() + 24);  // WAVE_FORMAT_EXTENSIBLE sub format
+            }
+            uint16_t bits = read_u16(body.data() + 14);
+            if (format != 3 || bits != 32) {
+                throw std::runtime_error("Decoded audio isn't 32-bit float");
+            }
+            audio.channels = read_u16(body.data() + 2);
+            audio.sample_rate = static_cast<int>(read_u32(body.data() + 4));
+            have_format = true;
+        }
+    }
+}
+
+// source frame range a segment covers
+std::pair<size_t, size_t> segment_frames(const PcmAudio& source, const AudioSegment& seg) {
+    size_t frames = source.frames();
+    double rate = source.sample_rate;
+    auto to_frame = [&](double seconds) {
+        double frame = std::round(seconds * rate);
+        return frame <= 0.0 ? size_t(0) : std::min(frames, static_cast<size_t>(frame));
+    };
+
+    size_t begin = to_frame(seg.start_seconds);
+    size_t end = std::max(begin, to_frame(seg.start_seconds + seg.duration_seconds));
+    return {begin, end};
+}
+
+// whole child stdout as a string
+std::string read_all(Subprocess& process) {
+    std::string out;
+    char buffer[65536];
+    while (size_t got = process.read(buffer, sizeof(buffer))) {
+        out.append(buffer, got);
+    }
+    return out;
+}
+
+// ffmpeg -progress output: blocks of key=value lines, out_time_us is how far
+// the output has got. Lines are picked out as the bytes arrive, a line split
+// between reads is carried in a fixed buffer so feeding never allocates.
+class ProgressParser {
+public:
+    // on_time(seconds) for every out_time_us seen
+    template <typename F>
+    void feed(const char* data, size_t size, F&& on_time) {
+        for (size_t i = 0; i < size; ++i) {
+            char c = data[i];
+            if (c == '\n') {
+                if (!m_overflow) parse_line(on_time);
+                m_length = 0;
+                m_overflow = false;
+            } else if (m_length < sizeof(m_line)) {
+                m_line[m_length++] = c;
+            } else {
+                m_overflow = true;  // nothing we want is this long
+            }
+        }
+    }
+
+private:
+    template <typename F>
+    void parse_line(F&& on_time) {
+        std::string_view line(m_line, m_length);
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+
+        // out_time_ms is microseconds too, older ffmpegs only write that one
+        for (std::string_view key : {"out_time_us=", "out_time_ms="}) {
+            if (line.substr(0, key.size()) != key) continue;
+            long long micros = 0;
+            auto value = line.substr(key.size());
+            auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), micros);
+            if (error == std::errc() && micros >= 0) {
+                on_time(micros / 1e6);
+            }
+            return;
+        }
+    }
+
+    char m_line[128];
+    size_t m_length = 0;
+    bool m_overflow = false;
+};
+
+// concat demuxer times are whole microseconds, in/out points have to round
+// towards the inside of the packet range or a neighbouring packet sneaks in
+std::string format_micros(double seconds, bool round_up) {
+    double micros = seconds * 1e6;
+    long long whole = static_cast<long long>(round_up ? std::ceil(micros - 1e-6) : std::floor(micros + 1e-6));
+    char buf[48];
+    snprintf(buf, sizeof(buf), "%s%lld.%06lld", whole < 0 ? "-" : "",
+             std::llabs(whole) / 1000000, std::llabs(whole) % 1000000);
+    return buf;
+}
+
+// file path for an ffconcat line, single quoted
+std::string quote_concat_path(const std::string& path) {
+    std::string quoted = "'";
+    for (char c : fs::path(path).generic_string()) {
+        if (c == '\'') {
+            quoted += "'\\''";
+        } else {
+            quoted += c;
+        }
+    }
+    quoted += "'";
+    return quoted;
+}
+
+} // namespace
+
+PcmAudio decode_audio(const std::string& ffmpeg_path, const std::string& source_path,
+                      std::stop_token stop, int sample_rate) {
+    std::vector<std::string> args = {ffmpeg_path, "-hide_banner", "-loglevel", "error", "-nostdin",
+                                     "-i", source_path, "-vn", "-c:a", "pcm_f32le"};
+    if (sample_rate > 0) {
+        args.push_back("-ar");
+        args.push_back(std::to_string(sample_rate));
+    }
+    args.insert(args.end(), {"-f", "wav", "pipe:1"});
+    Subprocess process(args, false, true);
+
+    auto fail = [&](int exit_code) {
+        return std::runtime_error("FFmpeg failed to decode " + source_path +
+                                  " (exit code " + std::to_string(exit_code) + ")");
+    };
+
+    PcmAudio audio;
+    try {
+        read_wav_header(process, audio);
+    } catch (const std::runtime_error&) {
+        // usually ffmpeg couldn't open the file, which says more than a bad header
+        int exit_code = process.wait();
+        if (exit_code != 0) throw fail(exit_code);
+        throw;
+    }
+    if (audio.channels <= 0 || audio.sample_rate <= 0) {
+        throw std::runtime_error("Decoded audio has no channels");
+    }
+
+    // read straight into the sample buffer, a partial sample can span reads
+    constexpr size_t READ_SAMPLES = 1 << 18;
+    size_t bytes = 0;
+    while (true) {
+        audio.samples.resize(bytes / sizeof(float) + READ_SAMPLES);
+        char* data = reinterpret_cast<char*>(audio.samples.data());
+        size_t got = process.read(data + bytes, audio.samples.size() * sizeof(float) - bytes);
+        if (got == 0) break;
+        if (stop.stop_requested()) throw AudioCancelled();
+        bytes += got;
+    }
+    size_t frame_bytes = sizeof(float) * static_cast<size_t>(audio.channels);
+    audio.samples.resize(bytes / frame_bytes * audio.channels);
+    audio.samples.shrink_to_fit();
+
+    int exit_code = process.wait();
+    if (exit_code != 0) {
+        throw fail(exit_code);
+    }
+    if (audio.samples.empty()) {
+        throw std::runtime_error("No audio decoded from " + source_path);
+    }
+    return audio;
+}
+
+size_t timeline_frames(const PcmAudio& source, const AudioTimeline& timeline) {
+    size_t total = 0;
+    for (const auto& block : timeline) {
+        size_t block_frames = 0;
+        for (const auto& seg : block.segments) {
+            auto [begin, end] = segment_frames(source, seg);
+            block_frames += (end - begin) * static_cast<size_t>(std::max(0, seg.repeat_count));
+        }
+        total += block_frames * static_cast<size_t>(std::max(0, block.repeat_count));
+    }
+    return total;
+}
+
+namespace {
+
+// render timeline as the part of a longer output that starts frame_offset
+// frames in, total frames long, with previous played just before it
+void render_frames(const PcmAudio& source,
+                   const AudioTimeline& timeline,
+                   bool fade_out,
+                   const PcmSink& sink,
+                   const AudioSegment* previous,
+                   size_t frame_offset,
+                   size_t total) {
+    const size_t channels = static_cast<size_t>(source.channels);
+    const size_t frames = source.frames();
+
+    // linear fade over the last second, same as afade=t=out:d=1
+    const double rate = source.sample_rate;
+    const size_t fade_begin = fade_out ? (total > static_cast<size_t>(rate) ? total - static_cast<size_t>(rate) : 0)
+                                       : total;
+    std::vector<float> faded;
+
+    const size_t seam_frames = static_cast<size_t>(SEAM_SECONDS * rate);
+    std::vector<float> gain_in, gain_out, seam, carried;
+    seam_gains(seam_frames, channels, gain_in, gain_out);
+
+    // where the audio before the next segment would have carried on
+    size_t carry = NO_CARRY;
+    if (previous) {
+        auto [begin, end] = segment_frames(source, *previous);
+        if (begin != end) carry = end;
+    }
+
+    size_t out_frame = frame_offset;
+    auto emit = [&](const float* samples, size_t count) {
+        if (out_frame + count <= fade_begin) {
+            // untouched audio goes out straight from the source
+            sink(samples, count);
+        } else {
+            faded.assign(samples, samples + count * channels);
+            for (size_t i = 0; i < count; ++i) {
+                size_t at = out_frame + i;
+                if (at < fade_begin) continue;
+                float gain = static_cast<float>(std::max(0.0, 1.0 - (at - fade_begin) / rate));
+                for (size_t c = 0; c < channels; ++c) {
+                    faded[i * channels + c] *= gain;
+                }
+            }
+            sink(faded.data(), count);
+        }
+        out_frame += count;
+    };
+
+    for_each_segment(timeline, [&](const AudioSegment& seg) {
+        auto [begin, end] = segment_frames(source, seg);
+        if (begin == end) return;
+
+        size_t frame = begin;
+        if (carry != NO_CARRY && carry != begin && seam_frames > 0) {
+            // fade out what would have played on while this one fades in,
+            // past the end of the source that's silence
+            size_t count = std::min(seam_frames, end - begin);
+            size_t samples = count * channels;
+            size_t have = carry < frames ? std::min(count, frames - carry) * channels : 0;
+            carried.assign(samples, 0.0f);
+            std::copy_n(source.data() + carry * channels, have, carried.begin());
+            seam.resize(samples);
+            mix_seam(seam.data(), source.data() + begin * channels, gain_in.data(),
+                     carried.data(), gain_out.data(), samples);
+            emit(seam.data(), count);
+            frame += count;
+        }
+        while (frame < end) {
+            size_t count = std::min(BLOCK_FRAMES, end - frame);
+            emit(source.data() + frame * channels, count);
+            frame += count;
+        }
+        carry = end;
+    });
+}
+
+} // namespace
+
+void render_timeline(const PcmAudio& source,
+                     const AudioTimeline& timeline,
+                     bool fade_out,
+                     const PcmSink& sink) {
+    render_frames(source, timeline, fade_out, sink, nullptr, 0, timeline_frames(source, timeline));
+}
+
+void render_piece(const PcmAudio& source,
+                  const TimelinePiece& piece,
+                  bool fade_out,
+                  const PcmSink& sink) {
+    render_frames(source, piece.timeline, fade_out, sink,
+                  piece.previous ? &*piece.previous : nullptr, piece.frame_offset, piece.total_frames);
+}
+
+namespace {
+
+// outputs shorter than two chunks of this are encoded in one go
+constexpr double MIN_CHUNK_SECONDS = 120.0;
+
+// neighbouring audio encoded either side of a section so the encoder has
+// settled by the time the section starts, it's cut off again when copying
+constexpr double SECTION_PAD_SECONDS = 0.25;
+
+// sheet encoding vs copying the output together, for progress
+constexpr double SECTION_ENCODE_SHARE = 0.75;
+
+// What one encoder writes. map_args[i] picks the stream for paths[i] when
+// there's a filter graph, without one there's a single output.
+struct EncodeOutputs {
+    std::vector<std::string> graph_args;
+    std::vector<std::vector<std::string>> map_args;
+    std::vector<std::string> paths;
+    std::string description;
+};
+
+// render a piece of the output (or all of it) into one ffmpeg reading raw
+// pcm on stdin, writing the outputs to paths (the chunk files or the real
+// outputs)
+void pipe_timeline(const std::string& ffmpeg_path,
+                   const PcmAudio& source,
+                   const TimelinePiece& piece,
+                   bool fade_out,
+                   const EncodeOutputs& outputs,
+                   const std::vector<std::string>& paths,
+                   const AudioProgress& progress,
+                   std::stop_token stop) {
+    std::vector<std::string> args = {ffmpeg_path, "-hide_banner", "-loglevel", "error", "-y",
+                                     "-f", "f32le", "-ar", std::to_string(source.sample_rate),
+                                     "-ac", std::to_string(source.channels), "-i", "pipe:0"};
+    args.insert(args.end(), outputs.graph_args.begin(), outputs.graph_args.end());
+    for (size_t i = 0; i < paths.size(); ++i) {
+        if (i < outputs.map_args.size()) {
+            args.insert(args.end(), outputs.map_args[i].begin(), outputs.map_args[i].end());
+        }
+        args.push_back(paths[i]);
+    }
+    Subprocess process(args, true, false);
+
+    const double rate = source.sample_rate;
+    const double total_seconds = timeline_frames(source, piece.timeline) / rate;
+    const size_t frame_bytes = sizeof(float) * static_cast<size_t>(source.channels);
+    size_t done_frames = 0;
+    bool broken = false;
+
+    render_piece(source, piece, fade_out, [&](const float* samples, size_t frames) {
+        if (broken) return;
+        // closing the pipe on the way out lets ffmpeg finish and exit
+        if (stop.stop_requested()) throw AudioCancelled();
+        if (!process.write(reinterpret_cast<const char*>(samples), frames * frame_bytes)) {
+            broken = true;  // ffmpeg gave up, the exit code says why
+            return;
+        }
+        done_frames += frames;
+        if (progress) {
+            progress(done_frames / rate, total_seconds);
+        }
+    });
+
+    process.close_stdin();
+    int exit_code = process.wait();
+    if (exit_code != 0 || broken) {
+        throw std::runtime_error("FFmpeg failed to encode " + outputs.description +
+                                 " (exit code " + std::to_string(exit_code) + ")");
+    }
+}
+
+// add one play of a segment, folded into the last block if it's the same one
+void append_segment(AudioTimeline& timeline, double start_seconds, double duration_seconds) {
+    if (!timeline.empty() && timeline.back().segments.size() == 1 &&
+        timeline.back().segments[0].start_seconds == start_seconds &&
+        timeline.back().segments[0].duration_seconds == duration_seconds) {
+        ++timeline.back().repeat_count;
+    } else {
+        timeline.push_back({{{start_seconds, duration_seconds, 1}}, 1});
+    }
+}
+
+// foo.ogg -> foo.<tag>.ogg, same extension so ffmpeg picks the same codec
+std::string sibling_path(const std::string& path, const std::string& tag) {
+    fs::path p(path);
+    return (p.parent_path() / (p.stem().string() + "." + tag + p.extension().string())).string();
+}
+
+std::string chunk_path(const std::string& path, size_t index) {
+    return sibling_path(path, "part" + std::to_string(index));
+}
+
+// Lossy encoders (opus, vorbis, mp3) prime every stream with padding that
+// only the first one's header accounts for, so chunks copied together would
+// grow by that at each join and drift behind the chart. Only outputs that
+// join back sample exact are chunked.
+bool joins_exactly(const std::vector<std::string>& paths) {
+    for (const auto& path : paths) {
+        std::string ext = fs::path(path).extension().string();
+        std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+        if (ext != ".wav" && ext != ".flac") return false;
+    }
+    return true;
+}
+
+// stream copy the chunks one after another into dest, the muxer redoes
+// the timestamps so the result is one ordinary stream
+void join_chunks(const std::string& ffmpeg_path, const std::vector<std::string>& chunks, const std::string& dest_path) {
+    std::string list_path = dest_path + ".ffconcat";
+    {
+        std::ofstream list(list_path, std::ios::binary);
+        if (!list) {
+            throw std::runtime_error("Cannot write " + list_path);
+        }
+        list << "ffconcat version 1.0\n";
+        for (const auto& chunk : chunks) {
+            list << "file " << quote_concat_path(chunk) << "\n";
+        }
+    }
+
+    int exit_code = -1;
+    try {
+        Subprocess process({ffmpeg_path, "-hide_banner", "-loglevel", "error", "-nostdin", "-y",
+                            "-f", "concat", "-safe", "0", "-i", list_path,
+                            "-map", "0:a:0", "-c", "copy", dest_path},
+                           false, false);
+        exit_code = process.wait();
+    } catch (...) {
+        std::error_code ignored;
+        fs::remove(list_path, ignored);
+        throw;
+    }
+    std::error_code ignored;
+    fs::remove(list_path, ignored);
+
+    if (exit_code != 0) {
+        throw std::runtime_error("FFmpeg failed to join " + dest_path +
+                                 " (exit code " + std::to_string(exit_code) + ")");
+    }
+}
+
+// encode in chunks on up to chunk_jobs encoders when the output is long
+// enough and its format joins exactly, else (or if joining fails) with one
+// encoder
+void encode_outputs(const std::string& ffmpeg_path,
+                    const PcmAudio& source,
+                    const AudioTimeline& timeline,
+                    bool fade_out,
+                    const EncodeOutputs& outputs,
+                    const AudioProgress& progress,
+                    std::stop_token stop,
+                    unsigned chunk_jobs) {
+    if (source.channels <= 0 || source.sample_rate <= 0) {
+        throw std::runtime_error("No audio to encode");
+    }
+
+    TimelinePiece whole{timeline, std::nullopt, 0, timeline_frames(source, timeline)};
+    const double total_seconds = whole.total_frames / static_cast<double>(source.sample_rate);
+    if (chunk_jobs == 0) {
+        chunk_jobs = std::max(1u, std::thread::hardware_concurrency());
+    }
+    size_t chunks = std::min<size_t>(chunk_jobs, static_cast<size_t>(total_seconds / MIN_CHUNK_SECONDS));
+
+    std::vector<TimelinePiece> parts;
+    if (chunks >= 2 && joins_exactly(outputs.paths)) {
+        parts = split_timeline(source, timeline, chunks);
+    }
+    if (parts.size() < 2) {
+        pipe_timeline(ffmpeg_path, source, whole, fade_out, outputs, outputs.paths, progress, stop);
+        return;
+    }
+
+    // chunk_files[c][i] is chunk c of output i
+    std::vector<std::vector<std::string>> chunk_files(parts.size());
+    for (size_t c = 0; c < parts.size(); ++c) {
+        for (const auto& path : outputs.paths) {
+            chunk_files[c].push_back(chunk_path(path, c));
+        }
+    }
+    auto remove_chunks = [&] {
+        std::error_code ignored;
+        for (const auto& files : chunk_files) {
+            for (const auto& file : files) fs::remove(file, ignored);
+        }
+    };
+
+    // progress comes from every worker, add it up under a lock
+    std::mutex progress_mutex;
+    std::vector<double> chunk_done(parts.size(), 0.0);
+    double done_seconds = 0.0;
+
+    std::exception_ptr failure;
+    std::mutex failure_mutex;
+    {
+        JobPool pool(static_cast<unsigned>(std::min<size_t>(chunk_jobs, parts.size())));
+        for (size_t c = 0; c < parts.size(); ++c) {
+            pool.submit([&, c] {
+                try {
+                    // each chunk renders as its stretch of the whole output, so
+                    // the seam into it and a fade that starts in an earlier
+                    // chunk come out as if it never split
+                    pipe_timeline(ffmpeg_path, source, parts[c], fade_out, outputs, chunk_files[c],
+                        [&](double done, double) {
+                            if (!progress) return;
+                            std::lock_guard<std::mutex> lock(progress_mutex);
+                            done_seconds += done - chunk_done[c];
+                            chunk_done[c] = done;
+                            progress(std::min(done_seconds, total_seconds), total_seconds);
+                        }, stop);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(failure_mutex);
+                    if (!failure) failure = std::current_exception();
+                }
+            });
+        }
+        pool.wait();
+    }
+    if (failure) {
+        remove_chunks();
+        std::rethrow_exception(failure);
+    }
+
+    try {
+        for (size_t i = 0; i < outputs.paths.size(); ++i) {
+            std::vector<std::string> files;
+            for (const auto& chunk : chunk_files) files.push_back(chunk[i]);
+            join_chunks(ffmpeg_path, files, outputs.paths[i]);
+        }
+    } catch (const std::exception&) {
+        // some formats dont stream copy back together, do it the slow way
+        remove_chunks();
+        pipe_timeline(ffmpeg_path, source, whole, fade_out, outputs, outputs.paths, progress, stop);
+        return;
+    }
+    remove_chunks();
+}
+
+} // namespace
+
+std::vector<TimelinePiece> split_timeline(const PcmAudio& source, const AudioTimeline& timeline, size_t pieces) {
+    const size_t total = timeline_frames(source, timeline);
+    std::vector<TimelinePiece> parts(1);
+    parts.back().total_frames = total;
+    size_t done = 0;
+
+    for_each_segment(timeline, [&](const AudioSegment& seg) {
+        auto [begin, end] = segment_frames(source, seg);
+        if (begin == end) return;
+
+        // start the next piece once this one has its share
+        if (parts.size() < pieces && done >= total * parts.size() / pieces && !parts.back().timeline.empty()) {
+            TimelinePiece next;
+            next.previous = parts.back().timeline.back().segments.back();
+            next.frame_offset = done;
+            next.total_frames = total;
+            parts.push_back(std::move(next));
+        }
+
+        // refold repeats so a piece stays a handful of blocks
+        append_segment(parts.back().timeline, seg.start_seconds, seg.duration_seconds);
+        done += end - begin;
+    });
+
+    if (parts.back().timeline.empty()) parts.pop_back();
+    return parts;
+}
+
+void encode_timeline(const std::string& ffmpeg_path,
+                     const PcmAudio& source,
+                     const AudioTimeline& timeline,
+                     bool fade_out,
+                     const std::string& dest_path,
+                     const AudioProgress& progress,
+                     std::stop_token stop,
+                     unsigned chunk_jobs) {
+    EncodeOutputs outputs;
+    outputs.paths = {dest_path};
+    outputs.description = dest_path;
+    encode_outputs(ffmpeg_path, source, timeline, fade_out, outputs, progress, stop, chunk_jobs);
+}
+
+PcmAudio interleave_stems(std::vector<PcmAudio>& stems) {
+    PcmAudio wide;
+    size_t frames = 0;
+    for (const auto& stem : stems) {
+        if (stem.channels <= 0) continue;
+        if (wide.sample_rate == 0) {
+            wide.sample_rate = stem.sample_rate;
+        } else if (stem.sample_rate != wide.sample_rate) {
+            throw std::runtime_error("Stems have different sample rates");
+        }
+        wide.channels += stem.channels;
+        frames = std::max(frames, stem.frames());
+    }
+
+    // short stems stay silent past their end
+    const size_t wide_channels = static_cast<size_t>(wide.channels);
+    wide.samples.assign(frames * wide_channels, 0.0f);
+
+    size_t channel_offset = 0;
+    for (auto& stem : stems) {
+        const size_t channels = static_cast<size_t>(stem.channels);
+        const size_t stem_frames = stem.frames();
+        const float* in = stem.data();
+        float* out = wide.samples.data() + channel_offset;
+        for (size_t frame = 0; frame < stem_frames; ++frame) {
+            std::copy_n(in + frame * channels, channels, out + frame * wide_channels);
+        }
+        channel_offset += channels;
+
+        // dont hold two copies of every stem
+        stem.release();
+    }
+    return wide;
+}
+
+void encode_stems(const std::string& ffmpeg_path,
+                  std::vector<PcmAudio> stems,
+                  const AudioTimeline& timeline,
+                  bool fade_out,
+                  const std::vector<std::string>& dest_paths,
+                  const AudioProgress& progress,
+                  std::stop_token stop,
+                  unsigned chunk_jobs) {
+    if (stems.size() != dest_paths.size()) {
+        throw std::runtime_error("Every stem needs an output");
+    }
+    if (stems.empty()) return;
+
+    // one output per stem, pan picks its channels back out of the wide stream
+    std::vector<int> channels;
+    for (const auto& stem : stems) {
+        channels.push_back(stem.channels);
+    }
+    PcmAudio wide = interleave_stems(stems);
+
+    std::string graph = "[0:a]asplit=" + std::to_string(dest_paths.size());
+    for (size_t i = 0; i < dest_paths.size(); ++i) {
+        graph += "[s" + std::to_string(i) + "]";
+    }
+    int channel_offset = 0;
+    for (size_t i = 0; i < dest_paths.size(); ++i) {
+        std::string layout = channels[i] == 1 ? "mono" : channels[i] == 2 ? "stereo"
+                                                                         : std::to_string(channels[i]) + "c";
+        graph += ";[s" + std::to_string(i) + "]pan=" + layout;
+        for (int c = 0; c < channels[i]; ++c) {
+            graph += "|c" + std::to_string(c) + "=c" + std::to_string(channel_offset + c);
+        }
+        graph += "[o" + std::to_string(i) + "]";
+        channel_offset += channels[i];
+    }
+
+    EncodeOutputs outputs;
+    outputs.graph_args = {"-filter_complex", graph};
+    for (size_t i = 0; i < dest_paths.size(); ++i) {
+        outputs.map_args.push_back({"-map", "[o" + std::to_string(i) + "]"});
+    }
+    outputs.paths = dest_paths;
+    outputs.description = std::to_string(dest_paths.size()) + " stems";
+
+    encode_outputs(ffmpeg_path, wide, timeline, fade_out, outputs, progress, stop, chunk_jobs);
+}
+
+bool encode_sections(const std::string& ffmpeg_path,
+                     const PcmAudio& source,
+                     const AudioTimeline& timeline,
+                     bool fade_out,
+                     const std::string& dest_path,
+                     const AudioProgress& progress,
+                     std::stop_token stop) {
+    if (source.channels <= 0 || source.sample_rate <= 0) {
+        throw std::runtime_error("No audio to encode");
+    }
+
+    const double rate = source.sample_rate;
+    const size_t total = timeline_frames(source, timeline);
+    const size_t pad = static_cast<size_t>(SECTION_PAD_SECONDS * rate);
+    // the fade is encoded on its own as the last piece of the sheet
+    const size_t tail = fade_out ? static_cast<size_t>(rate) : 0;
+    if (total < 2 * tail + 1) return false;
+    const size_t body_end = total - tail;
+
+    // Every distinct play gets one padded piece in the sheet. A play is its
+    // source range plus where the audio before it left off, the lead in comes
+    // from there so the seam crossfade is rendered into the piece as well.
+    std::map<std::tuple<size_t, size_t, size_t>, size_t> pieces;
+    AudioTimeline sheet;
+    size_t sheet_frames = 0;
+    auto add_range = [&](size_t begin, size_t end) {
+        sheet.push_back({{{begin / rate, (end - begin) / rate, 1}}, 1});
+        sheet_frames += end - begin;
+    };
+    // returns where [begin, end) starts in the sheet
+    auto add_piece = [&](size_t from, size_t begin, size_t end, size_t trail) {
+        size_t lead = std::min(pad, from);
+        add_range(from - lead, from);
+        size_t start = sheet_frames;
+        add_range(begin, end);
+        add_range(end, end + trail);
+        return start;
+    };
+
+    // the output in sheet time, and the source ranges of the faded tail
+    std::vector<std::pair<double, double>> plays;
+    std::vector<std::pair<size_t, size_t>> tail_ranges;
+    size_t out_frame = 0;
+    size_t carry = NO_CARRY;
+    size_t tail_from = 0;
+    for_each_segment(timeline, [&](const AudioSegment& seg) {
+        auto [begin, end] = segment_frames(source, seg);
+        if (begin == end) return;
+
+        size_t from = carry == NO_CARRY ? begin : carry;
+        size_t cut = std::clamp(body_end, out_frame, out_frame + (end - begin)) - out_frame + begin;
+        if (cut > begin) {
+            auto key = std::make_tuple(from, begin, end);
+            auto it = pieces.find(key);
+            if (it == pieces.end()) {
+                size_t trail = std::min(pad, source.frames() - end);
+                it = pieces.emplace(key, add_piece(from, begin, end, trail)).first;
+            }
+            plays.emplace_back(it->second / rate, (cut - begin) / rate);
+            tail_from = cut;
+        } else if (tail_ranges.empty()) {
+            tail_from = from;
+        }
+        if (cut < end) {
+            tail_ranges.emplace_back(cut, end);
+        }
+        carry = end;
+        out_frame += end - begin;
+    });
+
+    // not enough repetition to beat encoding the output straight
+    if (2 * (sheet_frames + tail + pad) > total) return false;
+
+    AudioTimeline copy_timeline;
+    for (const auto& [start, duration] : plays) {
+        append_segment(copy_timeline, start, duration);
+    }
+    if (!tail_ranges.empty()) {
+        // lead in from wherever the body left off, then the tail itself
+        size_t lead = std::min(pad, tail_from);
+        add_range(tail_from - lead, tail_from);
+        size_t tail_start = sheet_frames;
+        for (const auto& [begin, end] : tail_ranges) {
+            add_range(begin, end);
+        }
+        append_segment(copy_timeline, tail_start / rate, tail / rate);
+    }
+
+    std::string sheet_path = sibling_path(dest_path, "sections");
+    const double total_seconds = total / rate;
+    try {
+        encode_timeline(ffmpeg_path, source, sheet, fade_out, sheet_path,
+            [&](double done, double sheet_total) {
+                if (progress && sheet_total > 0) {
+                    progress(SECTION_ENCODE_SHARE * total_seconds * done / sheet_total, total_seconds);
+                }
+            }, stop);
+
+        stream_copy_timeline(ffmpeg_path, sheet_path, copy_timeline, dest_path,
+            [&](double done, double copy_total) {
+                if (progress && copy_total > 0) {
+                    double share = SECTION_ENCODE_SHARE + (1.0 - SECTION_ENCODE_SHARE) * done / copy_total;
+                    progress(std::min(1.0, share) * total_seconds, total_seconds);
+                }
+            }, stop);
+    } catch (...) {
+        std::error_code ignored;
+        fs::remove(sheet_path, ignored);
+        throw;
+    }
+    std::error_code ignored;
+    fs::remove(sheet_path, ignored);
+    return true;
+}
+
+std::vector<double> probe_packet_boundaries(const std::string& ffmpeg_path, const std::string& source_path) {
+    // framecrc lists every packet without decoding: "stream, dts, pts, duration, size, crc"
+    Subprocess process({ffmpeg_path, "-hide_banner", "-loglevel", "error", "-nostdin",
+                        "-i", source_path, "-map", "0:a:0", "-c", "copy", "-f", "framecrc", "pipe:1"},
+                       false, true);
+    std::string listing = read_all(process);
+    int exit_code = process.wait();
+    if (exit_code != 0) {
+        throw std::runtime_error("FFmpeg failed to read packets from " + source_path +
+                                 " (exit code " + std::to_string(exit_code) + ")");
+    }
+
+    double time_base = 0.0;
+    std::vector<double> boundaries;
+    double end = 0.0;
+
+    std::istringstream lines(listing);
+    std::string line;
+    while (std::getline(lines, line)) {
+        if (line.rfind("#tb 0:", 0) == 0) {
+            long long num = 0, den = 0;
+            if (sscanf(line.c_str() + 6, " %lld/%lld", &num, &den) == 2 && den != 0) {
+                time_base = static_cast<double>(num) / static_cast<double>(den);
+            }
+            continue;
+        }
+        if (line.empty() || line[0] == '#') continue;
+
+        long long stream = 0, dts = 0, pts = 0, duration = 0;
+        if (sscanf(line.c_str(), "%lld, %lld, %lld, %lld", &stream, &dts, &pts, &duration) != 4 || stream != 0) {
+            continue;
+        }
+        double start = pts * time_base;
+        if (!boundaries.empty() && start <= boundaries.back()) continue;  // out of order, cant cut here
+        boundaries.push_back(start);
+        end = std::max(end, (pts + duration) * time_base);
+    }
+
+    if (time_base <= 0.0 || boundaries.empty()) {
+        throw std::runtime_error("No audio packets found in " + source_path);
+    }
+    if (end > boundaries.back()) {
+        boundaries.push_back(end);
+    }
+    return boundaries;
+}
+
+std::vector<CopyRange> snap_to_packets(const std::vector<double>& boundaries,
+                                       const AudioTimeline& timeline) {
+    std::vector<CopyRange> ranges;
+    if (boundaries.size() < 2) return ranges;
+
+    auto nearest = [&](double seconds, size_t lowest) {
+        auto it = std::lower_bound(boundaries.begin() + lowest, boundaries.end(), seconds);
+        if (it == boundaries.end()) return boundaries.size() - 1;
+        size_t index = static_cast<size_t>(it - boundaries.begin());
+        if (index > lowest && seconds - boundaries[index - 1] < *it - seconds) --index;
+        return index;
+    };
+
+    const double source_end = boundaries.back();
+    double ideal_elapsed = 0.0;
+    double actual_elapsed = 0.0;
+
+    for_each_segment(timeline, [&](const AudioSegment& seg) {
+        double start = std::clamp(seg.start_seconds, 0.0, source_end);
+        ideal_elapsed += std::clamp(seg.duration_seconds, 0.0, source_end - start);
+
+        size_t in = std::min(nearest(start, 0), boundaries.size() - 2);
+        // end where the output catches up with the exact timeline, at least one packet
+        size_t out = std::max(in + 1, nearest(boundaries[in] + (ideal_elapsed - actual_elapsed), in));
+        actual_elapsed += boundaries[out] - boundaries[in];
+
+        ranges.push_back({boundaries[in], boundaries[out]});
+    });
+    return ranges;
+}
+
+void stream_copy_timeline(const std::string& ffmpeg_path,
+                          const std::string& source_path,
+                          const AudioTimeline& timeline,
+                          const std::string& dest_path,
+                          const AudioProgress& progress,
+                          std::stop_token stop) {
+    auto ranges = snap_to_packets(probe_packet_boundaries(ffmpeg_path, source_path), timeline);
+    if (ranges.empty()) {
+        throw std::runtime_error("No audio to copy");
+    }
+
+    double total_seconds = 0.0;
+    std::string list_path = dest_path + ".ffconcat";
+    {
+        std::ofstream list(list_path, std::ios::binary);
+        if (!list) {
+            throw std::runtime_error("Cannot write " + list_path);
+        }
+        list << "ffconcat version 1.0\n";
+        std::string file_line = "file " + quote_concat_path(source_path) + "\n";
+        for (const auto& range : ranges) {
+            list << file_line
+                 << "inpoint " << format_micros(range.in_seconds, true) << "\n"
+                 << "outpoint " << format_micros(range.out_seconds, false) << "\n";
+            total_seconds += range.out_seconds - range.in_seconds;
+        }
+    }
+
+    if (stop.stop_requested()) {
+        std::error_code ignored;
+        fs::remove(list_path, ignored);
+        throw AudioCancelled();
+    }
+
+    int exit_code = -1;
+    try {
+        // copying is quick, but long loops still take a while, so follow -progress
+        Subprocess process({ffmpeg_path, "-hide_banner", "-loglevel", "error", "-nostdin", "-nostats", "-y",
+                            "-progress", "pipe:1",
+                            "-f", "concat", "-safe", "0", "-i", list_path,
+                            "-map", "0:a:0", "-c", "copy", dest_path},
+                           false, true);
+
+        ProgressParser parser;
+        char buffer[4096];
+        while (size_t got = process.read(buffer, sizeof(buffer))) {
+            if (stop.stop_requested()) {
+                process.terminate();
+                throw AudioCancelled();
+            }
+            if (progress) {
+                parser.feed(buffer, got, [&](double seconds) {
+                    progress(std::min(seconds, total_seconds), total_seconds);
+                });
+            }
+        }
+        exit_code = process.wait();
+    } catch (...) {
+        std::error_code ignored;
+        fs::remove(list_path, ignored);
+        throw;
+    }
+    std::error_code ignored;
+    fs::remove(list_path, ignored);
+
+    if (exit_code != 0) {
+        throw std::runtime_error("FFmpeg failed to copy audio to " + dest_path +
+                                 " (exit code " + std::to_string(exit_code) + ")");
+    }
+    if (progress) {
+        progress(total_seconds, total_seconds);
+    }
+}
+
+} // namespace NoteGen
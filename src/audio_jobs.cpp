@@ -0,0 +1,260 @@
+#include "audio_jobs.hpp"
+#include "job_pool.hpp"
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace NoteGen {
+
+namespace {
+
+unsigned job_count(const StemOptions& options, size_t stems) {
+    // no more workers than stems
+    unsigned jobs = options.max_jobs ? options.max_jobs : std::max(1u, std::thread::hardware_concurrency());
+    return static_cast<unsigned>(std::min<size_t>(jobs, stems));
+}
+
+// encoders per output for long outputs, whatever the stem workers leave over
+unsigned chunk_jobs(const StemOptions& options, size_t outputs) {
+    unsigned jobs = options.max_jobs ? options.max_jobs : std::max(1u, std::thread::hardware_concurrency());
+    return std::max(1u, static_cast<unsigned>(jobs / std::max<size_t>(outputs, 1)));
+}
+
+PcmAudio decode_stem(const std::string& ffmpeg_path, const StemJob& stem, const StemOptions& options,
+                     std::stop_token stop, int sample_rate = 0) {
+    if (options.cache) {
+        return options.cache->decode(ffmpeg_path, stem.source_path, stop, sample_rate);
+    }
+    return decode_audio(ffmpeg_path, stem.source_path, stop, sample_rate);
+}
+
+void remove_output(const StemJob& stem) {
+    std::error_code ignored;
+    fs::remove(stem.dest_path, ignored);
+}
+
+void process_stem(const std::string& ffmpeg_path,
+                  const StemJob& stem,
+                  const AudioTimeline& timeline,
+                  const StemOptions& options,
+                  StemProgress& progress,
+                  size_t index,
+                  std::stop_token stop,
+                  unsigned encoders,
+                  StemResult& result) {
+    if (stop.stop_requested()) {
+        result.state = StemState::Cancelled;
+        progress.set_state(index, result.state);
+        return;
+    }
+    progress.set_state(index, StemState::Working);
+
+    auto report = [&](double done, double total) {
+        if (total > 0) {
+            progress.set_fraction(index, std::min(1.0, done / total));
+        }
+    };
+
+    try {
+        bool copied = false;
+        // full song needs the fade so it always re-encodes
+        if (options.stream_copy && !options.fade_out) {
+            try {
+                stream_copy_timeline(ffmpeg_path, stem.source_path, timeline, stem.dest_path, report, stop);
+                copied = true;
+            } catch (const AudioCancelled&) {
+                throw;
+            } catch (const std::exception&) {
+            }
+        }
+
+        if (!copied) {
+            auto source = decode_stem(ffmpeg_path, stem, options, stop);
+            // next best is encoding each section once and copying those
+            if (options.stream_copy) {
+                try {
+                    copied = encode_sections(ffmpeg_path, source, timeline, options.fade_out, stem.dest_path,
+                                             report, stop);
+                } catch (const AudioCancelled&) {
+                    throw;
+                } catch (const std::exception&) {
+                }
+            }
+            if (!copied) {
+                encode_timeline(ffmpeg_path, source, timeline, options.fade_out, stem.dest_path, report, stop,
+                                encoders);
+            }
+        }
+        progress.set_fraction(index, 1.0);
+        result.state = StemState::Done;
+    } catch (const AudioCancelled&) {
+        remove_output(stem);
+        result.state = StemState::Cancelled;
+    } catch (const std::exception& e) {
+        result.error = e.what();
+        result.state = StemState::Failed;
+    }
+    progress.set_state(index, result.state);
+}
+
+// decode everything, then one encoder for all of them. false if the encode
+// failed and the stems should be tried one by one
+bool process_stems_shared(const std::string& ffmpeg_path,
+                          const std::vector<StemJob>& stems,
+                          const AudioTimeline& timeline,
+                          const StemOptions& options,
+                          StemProgress& progress,
+                          std::stop_token stop,
+                          std::vector<StemResult>& results) {
+    std::vector<PcmAudio> decoded(stems.size());
+
+    auto decode = [&](size_t i, int sample_rate) {
+        if (stop.stop_requested()) {
+            results[i].state = StemState::Cancelled;
+            return;
+        }
+        progress.set_state(i, StemState::Working);
+        try {
+            decoded[i] = decode_stem(ffmpeg_path, stems[i], options, stop, sample_rate);
+            results[i].state = StemState::Working;
+        } catch (const AudioCancelled&) {
+            results[i].state = StemState::Cancelled;
+        } catch (const std::exception& e) {
+            results[i].error = e.what();
+            results[i].state = StemState::Failed;
+        }
+    };
+
+    {
+        JobPool pool(job_count(options, stems.size()));
+        for (size_t i = 0; i < stems.size(); ++i) {
+            pool.submit([&, i] { decode(i, 0); });
+        }
+        pool.wait();
+
+        // the wide stream has one rate, resample the odd ones out to the first stem's
+        int sample_rate = 0;
+        for (size_t i = 0; i < stems.size(); ++i) {
+            if (results[i].state != StemState::Working) continue;
+            if (sample_rate == 0) {
+                sample_rate = decoded[i].sample_rate;
+            } else if (decoded[i].sample_rate != sample_rate) {
+                decoded[i] = PcmAudio();
+                pool.submit([&, i, sample_rate] { decode(i, sample_rate); });
+            }
+        }
+        pool.wait();
+    }
+
+    std::vector<size_t> working;
+    std::vector<PcmAudio> sources;
+    std::vector<std::string> dest_paths;
+    for (size_t i = 0; i < stems.size(); ++i) {
+        if (results[i].state == StemState::Working) {
+            working.push_back(i);
+            sources.push_back(std::move(decoded[i]));
+            dest_paths.push_back(stems[i].dest_path);
+        } else {
+            progress.set_state(i, results[i].state);
+        }
+    }
+    decoded.clear();
+    if (working.empty()) return true;
+
+    auto report = [&](double done, double total) {
+        if (total > 0) {
+            for (size_t i : working) {
+                progress.set_fraction(i, std::min(1.0, done / total));
+            }
+        }
+    };
+
+    StemState outcome = StemState::Done;
+    try {
+        encode_stems(ffmpeg_path, std::move(sources), timeline, options.fade_out, dest_paths, report, stop,
+                     chunk_jobs(options, 1));
+    } catch (const AudioCancelled&) {
+        outcome = StemState::Cancelled;
+    } catch (const std::exception&) {
+        // cant tell which output broke it, start those stems over on their own
+        for (size_t i : working) {
+            remove_output(stems[i]);
+            results[i] = StemResult();
+            progress.set_fraction(i, 0.0);
+            progress.set_state(i, StemState::Queued);
+        }
+        return false;
+    }
+
+    for (size_t i : working) {
+        if (outcome == StemState::Cancelled) {
+            remove_output(stems[i]);
+        } else {
+            progress.set_fraction(i, 1.0);
+        }
+        results[i].state = outcome;
+        progress.set_state(i, outcome);
+    }
+    return true;
+}
+
+} // namespace
+
+bool is_audio_file(const std::string& path) {
+    std::string ext = fs::path(path).extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+    return ext == ".ogg" || ext == ".opus" || ext == ".mp3" || ext == ".wav";
+}
+
+double StemProgress::total_fraction() const {
+    if (m_fractions.empty()) return 1.0;
+    double sum = 0.0;
+    for (size_t i = 0; i < m_fractions.size(); ++i) {
+        // failed and cancelled stems are as done as they'll get
+        sum += state(i) >= StemState::Done ? 1.0 : fraction(i);
+    }
+    return sum / m_fractions.size();
+}
+
+size_t StemProgress::finished() const {
+    size_t count = 0;
+    for (size_t i = 0; i < m_states.size(); ++i) {
+        if (state(i) >= StemState::Done) ++count;
+    }
+    return count;
+}
+
+std::vector<StemResult> process_stems(const std::string& ffmpeg_path,
+                                      const std::vector<StemJob>& stems,
+                                      const AudioTimeline& timeline,
+                                      const StemOptions& options,
+                                      StemProgress& progress,
+                                      std::stop_token stop) {
+    std::vector<StemResult> results(stems.size());
+    if (stems.empty()) return results;
+
+    // stream copy and section encoding are per stem, so theres nothing to share
+    if (options.shared_encode && stems.size() > 1 && !options.stream_copy) {
+        if (process_stems_shared(ffmpeg_path, stems, timeline, options, progress, stop, results)) {
+            return results;
+        }
+    }
+
+    unsigned workers = job_count(options, stems.size());
+    unsigned encoders = chunk_jobs(options, workers);
+    JobPool pool(workers);
+    for (size_t i = 0; i < stems.size(); ++i) {
+        if (results[i].state != StemState::Queued) continue;
+        pool.submit([&, i] {
+            process_stem(ffmpeg_path, stems[i], timeline, options, progress, i, stop, encoders, results[i]);
+        });
+    }
+    pool.wait();
+
+    return results;
+}
+
+} // namespace NoteGen
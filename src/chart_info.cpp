@@ -1,5 +1,6 @@
 #include "chart_info.hpp"
 #include "loop_generator.hpp"
+#include "song_io.hpp"
 
 namespace NoteGen {
 
@@ -55,28 +56,8 @@ nlohmann::json get_available_tracks(const SightRead::Song& song) {
         for (auto diff : difficulties) {
             nlohmann::json track;
             
-            // instrument to string
-            switch (inst) {
-                case SightRead::Instrument::Guitar: track["instrument"] = "Guitar"; break;
-                case SightRead::Instrument::GuitarCoop: track["instrument"] = "GuitarCoop"; break;
-                case SightRead::Instrument::Bass: track["instrument"] = "Bass"; break;
-                case SightRead::Instrument::Rhythm: track["instrument"] = "Rhythm"; break;
-                case SightRead::Instrument::Keys: track["instrument"] = "Keys"; break;
-                case SightRead::Instrument::GHLGuitar: track["instrument"] = "GHLGuitar"; break;
-                case SightRead::Instrument::GHLBass: track["instrument"] = "GHLBass"; break;
-                case SightRead::Instrument::GHLRhythm: track["instrument"] = "GHLRhythm"; break;
-                case SightRead::Instrument::GHLGuitarCoop: track["instrument"] = "GHLGuitarCoop"; break;
-                case SightRead::Instrument::Drums: track["instrument"] = "Drums"; break;
-                default: track["instrument"] = "Unknown"; break;
-            }
-            
-            // difficulty to string
-            switch (diff) {
-                case SightRead::Difficulty::Easy: track["difficulty"] = "Easy"; break;
-                case SightRead::Difficulty::Medium: track["difficulty"] = "Medium"; break;
-                case SightRead::Difficulty::Hard: track["difficulty"] = "Hard"; break;
-                case SightRead::Difficulty::Expert: track["difficulty"] = "Expert"; break;
-            }
+            track["instrument"] = instrument_to_string(inst);
+            track["difficulty"] = difficulty_to_string(diff);
             
             // note count
             try {
@@ -1,14 +1,225 @@
 #include "chart_writer.hpp"
-#include <iomanip>
-#include <sstream>
+#include "job_pool.hpp"
+#include "loop_plan.hpp"
 #include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <climits>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
 #include <vector>
 
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
 namespace NoteGen {
 
+namespace {
+
 // clone hero/moonscraper format
-const char* LINE_END = "\r\n";
-const char* INDENT = "  ";  // two spaces not tabs
+constexpr std::string_view LINE_END = "\r\n";
+constexpr std::string_view INDENT = "  ";  // two spaces not tabs
+
+// big enough that a chart goes out in a handful of writes
+constexpr size_t OUTPUT_BUFFER_SIZE = 256 * 1024;
+
+// below this many notes a track is written on the calling thread, starting
+// workers costs more than it saves
+constexpr size_t PARALLEL_MIN_NOTES = 16384;
+
+// chunks per worker, so one slow chunk doesn't hold everyone up
+constexpr size_t CHUNKS_PER_THREAD = 4;
+
+} // namespace
+
+// Lines are formatted straight into the writer's buffer and handed to the
+// stream/fd whenever it fills up, so nothing is allocated per line and the
+// whole chart is never held in memory.
+class ChartOutput {
+public:
+    ChartOutput(std::ostream& out, std::vector<char>& buffer) : m_stream(&out), m_buffer(buffer) {
+        init_buffer();
+    }
+    ChartOutput(int fd, std::vector<char>& buffer) : m_fd(fd), m_buffer(buffer) {
+        init_buffer();
+    }
+
+    ChartOutput(const ChartOutput&) = delete;
+    ChartOutput& operator=(const ChartOutput&) = delete;
+
+    void put(char c) {
+        if (m_size == m_buffer.size()) drain();
+        m_buffer[m_size++] = c;
+    }
+
+    void put(std::string_view str) {
+        while (!str.empty()) {
+            if (m_size == m_buffer.size()) drain();
+            size_t n = std::min(str.size(), m_buffer.size() - m_size);
+            std::memcpy(m_buffer.data() + m_size, str.data(), n);
+            m_size += n;
+            str.remove_prefix(n);
+        }
+    }
+
+    void put_int(int64_t value) {
+        // 20 chars covers every int64 including the sign
+        if (m_buffer.size() - m_size < 20) drain();
+        char* begin = m_buffer.data() + m_size;
+        auto result = std::to_chars(begin, m_buffer.data() + m_buffer.size(), value);
+        m_size += static_cast<size_t>(result.ptr - begin);
+    }
+
+    // start a track line: indent and absolute tick
+    void line(int64_t tick) {
+        put(INDENT);
+        put_int(tick);
+    }
+
+    // hand everything buffered so far to the sink
+    void flush() {
+        drain();
+        if (m_stream) m_stream->flush();
+    }
+
+    // write pre-formatted chunks in order after whats already buffered,
+    // with a single vectored write where the platform has one
+    void put_chunks(const std::vector<std::string>& chunks, size_t count) {
+        drain();
+        if (m_stream) {
+            for (size_t i = 0; i < count; ++i) {
+                m_stream->write(chunks[i].data(), static_cast<std::streamsize>(chunks[i].size()));
+            }
+            return;
+        }
+#ifdef _WIN32
+        for (size_t i = 0; i < count; ++i) {
+            write_fd(chunks[i].data(), chunks[i].size());
+        }
+#else
+#ifdef IOV_MAX
+        const size_t max_iov = IOV_MAX;
+#else
+        const size_t max_iov = 16;
+#endif
+        std::vector<iovec> iov;
+        for (size_t i = 0; i < count; ++i) {
+            if (chunks[i].empty()) continue;
+            iov.push_back({const_cast<char*>(chunks[i].data()), chunks[i].size()});
+        }
+
+        size_t next = 0;
+        while (next < iov.size()) {
+            int batch = static_cast<int>(std::min(iov.size() - next, max_iov));
+            ssize_t written = ::writev(m_fd, iov.data() + next, batch);
+            if (written < 0 && errno == EINTR) continue;
+            if (written <= 0) {
+                throw std::runtime_error(std::string("Failed to write chart: ") + std::strerror(errno));
+            }
+
+            // skip whatever went out, a short write can stop mid chunk
+            size_t left = static_cast<size_t>(written);
+            while (next < iov.size() && left >= iov[next].iov_len) {
+                left -= iov[next].iov_len;
+                ++next;
+            }
+            if (left > 0) {
+                iov[next].iov_base = static_cast<char*>(iov[next].iov_base) + left;
+                iov[next].iov_len -= left;
+            }
+        }
+#endif
+    }
+
+private:
+    void init_buffer() {
+        if (m_buffer.size() < OUTPUT_BUFFER_SIZE) m_buffer.resize(OUTPUT_BUFFER_SIZE);
+    }
+
+    void drain() {
+        if (m_size == 0) return;
+
+        if (m_stream) {
+            m_stream->write(m_buffer.data(), static_cast<std::streamsize>(m_size));
+        } else {
+            write_fd(m_buffer.data(), m_size);
+        }
+        m_size = 0;
+    }
+
+    void write_fd(const char* data, size_t left) {
+        while (left > 0) {
+#ifdef _WIN32
+            int written = ::_write(m_fd, data, static_cast<unsigned>(std::min<size_t>(left, 1u << 30)));
+#else
+            ssize_t written = ::write(m_fd, data, left);
+            if (written < 0 && errno == EINTR) continue;
+#endif
+            if (written <= 0) {
+                throw std::runtime_error(std::string("Failed to write chart: ") + std::strerror(errno));
+            }
+            data += written;
+            left -= static_cast<size_t>(written);
+        }
+    }
+
+    std::ostream* m_stream = nullptr;
+    int m_fd = -1;
+    std::vector<char>& m_buffer;
+    size_t m_size = 0;
+};
+
+void SyncTrackBuilder::add(const SyncTrackEvent& event) {
+    if (event.is_bpm) {
+        add_bpm(event.position, event.bpm);
+    } else {
+        add_time_sig(event.position, event.ts_num, event.ts_denom);
+    }
+}
+
+void SyncTrackBuilder::add_bpm(SightRead::Tick position, int64_t bpm) {
+    if (m_last_bpm) {
+        // already have one here, or it wouldnt change the tempo
+        if (m_last_bpm->position == position || m_last_bpm->bpm == bpm) return;
+    }
+
+    SyncTrackEvent event;
+    event.position = position;
+    event.is_bpm = true;
+    event.bpm = bpm;
+    m_events.push_back(event);
+    m_last_bpm = event;
+}
+
+void SyncTrackBuilder::add_time_sig(SightRead::Tick position, int numerator, int denominator) {
+    if (m_last_ts) {
+        if (m_last_ts->position == position) return;
+
+        // same time sig is only redundant if it lands on a bar line,
+        // otherwise it restarts the measure and has to stay
+        if (m_last_ts->ts_num == numerator && m_last_ts->ts_denom == denominator) {
+            int64_t measure_ticks = static_cast<int64_t>(m_resolution) * 4 * numerator / denominator;
+            int64_t since_last = position.value() - m_last_ts->position.value();
+            if (measure_ticks > 0 && since_last % measure_ticks == 0) return;
+        }
+    }
+
+    SyncTrackEvent event;
+    event.position = position;
+    event.is_bpm = false;
+    event.ts_num = numerator;
+    event.ts_denom = denominator;
+    m_events.push_back(event);
+    m_last_ts = event;
+}
 
 void ChartWriter::write(std::ostream& out,
                         const ChartMetadata& metadata,
@@ -17,130 +228,470 @@ void ChartWriter::write(std::ostream& out,
                         const std::map<std::pair<SightRead::Instrument, SightRead::Difficulty>,
                                       std::vector<SightRead::Note>>& tracks,
                         const std::vector<SightRead::StarPower>& sp_phrases) {
-    write_song_section(out, metadata);
-    write_sync_track(out, sync_events);
-    write_events(out, sections);
+    ChartOutput output(out, m_buffer);
+    write_song_section(output, metadata);
+    write_sync_track(output, sync_events);
+    write_events(output, sections);
     
     // write each track
     for (const auto& [key, notes] : tracks) {
         auto track_name = instrument_difficulty_to_track_name(key.first, key.second);
-        write_note_track(out, track_name, notes, sp_phrases);
+        write_note_track(output, track_name, notes, sp_phrases);
     }
+    output.flush();
 }
 
-void ChartWriter::write_song_section(std::ostream& out, const ChartMetadata& metadata) {
-    out << "[Song]" << LINE_END << "{" << LINE_END;
-    out << INDENT << "Name = \"" << metadata.name << "\"" << LINE_END;
-    out << INDENT << "Artist = \"" << metadata.artist << "\"" << LINE_END;
-    out << INDENT << "Charter = \"" << metadata.charter << "\"" << LINE_END;
-    out << INDENT << "Offset = 0" << LINE_END;
-    out << INDENT << "Resolution = " << metadata.resolution << LINE_END;
-    out << INDENT << "Player2 = bass" << LINE_END;
-    out << INDENT << "Difficulty = 0" << LINE_END;
-    out << INDENT << "PreviewStart = 0" << LINE_END;
-    out << INDENT << "PreviewEnd = 0" << LINE_END;
-    out << INDENT << "Genre = \"Practice\"" << LINE_END;
-    out << INDENT << "MediaType = \"cd\"" << LINE_END;
-    out << INDENT << "MusicStream = \"song.ogg\"" << LINE_END;
-    out << "}" << LINE_END;
+void ChartWriter::write(std::ostream& out,
+                        const ChartMetadata& metadata,
+                        const std::vector<SyncTrackEvent>& sync_events,
+                        const std::vector<LoopedSection>& sections,
+                        SightRead::Instrument instrument,
+                        SightRead::Difficulty difficulty,
+                        const LoopPlan& plan) {
+    ChartOutput output(out, m_buffer);
+    write_plan(output, metadata, sync_events, sections, instrument, difficulty, plan);
+}
+
+void ChartWriter::write(int fd,
+                        const ChartMetadata& metadata,
+                        const std::vector<SyncTrackEvent>& sync_events,
+                        const std::vector<LoopedSection>& sections,
+                        SightRead::Instrument instrument,
+                        SightRead::Difficulty difficulty,
+                        const LoopPlan& plan) {
+    ChartOutput output(fd, m_buffer);
+    write_plan(output, metadata, sync_events, sections, instrument, difficulty, plan);
+}
+
+void ChartWriter::write_plan(ChartOutput& out,
+                             const ChartMetadata& metadata,
+                             const std::vector<SyncTrackEvent>& sync_events,
+                             const std::vector<LoopedSection>& sections,
+                             SightRead::Instrument instrument,
+                             SightRead::Difficulty difficulty,
+                             const LoopPlan& plan) {
+    write_song_section(out, metadata);
+    write_sync_track(out, sync_events);
+    write_events(out, sections);
+    write_note_track(out, instrument_difficulty_to_track_name(instrument, difficulty), plan);
+    out.flush();
+}
+
+void ChartWriter::write_song_section(ChartOutput& out, const ChartMetadata& metadata) {
+    auto string_field = [&](std::string_view key, std::string_view value) {
+        out.put(INDENT); out.put(key); out.put(" = \""); out.put(value); out.put('"'); out.put(LINE_END);
+    };
+    auto plain_field = [&](std::string_view key, std::string_view value) {
+        out.put(INDENT); out.put(key); out.put(" = "); out.put(value); out.put(LINE_END);
+    };
+    
+    out.put("[Song]"); out.put(LINE_END); out.put('{'); out.put(LINE_END);
+    string_field("Name", metadata.name);
+    string_field("Artist", metadata.artist);
+    string_field("Charter", metadata.charter);
+    plain_field("Offset", "0");
+    out.put(INDENT); out.put("Resolution = "); out.put_int(metadata.resolution); out.put(LINE_END);
+    plain_field("Player2", "bass");
+    plain_field("Difficulty", "0");
+    plain_field("PreviewStart", "0");
+    plain_field("PreviewEnd", "0");
+    string_field("Genre", "Practice");
+    string_field("MediaType", "cd");
+    string_field("MusicStream", "song.ogg");
+    out.put('}'); out.put(LINE_END);
 }
 
-void ChartWriter::write_sync_track(std::ostream& out, const std::vector<SyncTrackEvent>& sync_events) {
-    out << "[SyncTrack]" << LINE_END << "{" << LINE_END;
+void ChartWriter::write_sync_track(ChartOutput& out, const std::vector<SyncTrackEvent>& sync_events) {
+    out.put("[SyncTrack]"); out.put(LINE_END); out.put('{'); out.put(LINE_END);
     
     for (const auto& event : sync_events) {
+        out.put(INDENT);
+        out.put_int(event.position.value());
         if (event.is_bpm) {
-            out << INDENT << event.position.value() << " = B " << event.bpm << LINE_END;
+            out.put(" = B ");
+            out.put_int(event.bpm);
         } else {
-            out << INDENT << event.position.value() << " = TS " << event.ts_num;
+            out.put(" = TS ");
+            out.put_int(event.ts_num);
             if (event.ts_denom != 4) {
                 int denom_log = 0;
                 int d = event.ts_denom;
                 while (d > 1) { d /= 2; denom_log++; }
-                out << " " << denom_log;
+                out.put(' ');
+                out.put_int(denom_log);
             }
-            out << LINE_END;
         }
+        out.put(LINE_END);
     }
     
-    out << "}" << LINE_END;
+    out.put('}'); out.put(LINE_END);
 }
 
-void ChartWriter::write_events(std::ostream& out, const std::vector<LoopedSection>& sections) {
-    out << "[Events]" << LINE_END << "{" << LINE_END;
+void ChartWriter::write_events(ChartOutput& out, const std::vector<LoopedSection>& sections) {
+    out.put("[Events]"); out.put(LINE_END); out.put('{'); out.put(LINE_END);
     
     for (const auto& section : sections) {
-        out << INDENT << section.start.value() << " = E \"section " << section.name << "\"" << LINE_END;
+        out.put(INDENT);
+        out.put_int(section.start.value());
+        out.put(" = E \"section ");
+        out.put(section.name);
+        out.put('"');
+        out.put(LINE_END);
     }
     
     // end event after last section
     if (!sections.empty()) {
-        out << INDENT << sections.back().end.value() << " = E \"end\"" << LINE_END;
+        out.put(INDENT);
+        out.put_int(sections.back().end.value());
+        out.put(" = E \"end\"");
+        out.put(LINE_END);
+    }
+    
+    out.put('}'); out.put(LINE_END);
+}
+
+namespace {
+
+// Collects a run of track lines as relative ticks plus the text after the
+// tick, same interface as ChartOutput so the line writers below work on both
+class TemplateRecorder {
+public:
+    TemplateRecorder(SectionTemplate& target, int64_t origin) : m_target(target), m_origin(origin) {
+        m_target.ticks.clear();
+        m_target.line_begin.clear();
+        m_target.text.clear();
+    }
+
+    void line(int64_t tick) {
+        m_target.ticks.push_back(tick - m_origin);
+        m_target.line_begin.push_back(static_cast<uint32_t>(m_target.text.size()));
+    }
+    void put(char c) { m_target.text.push_back(c); }
+    void put(std::string_view str) { m_target.text.append(str); }
+    void put_int(int64_t value) {
+        char digits[20];
+        auto result = std::to_chars(digits, digits + sizeof(digits), value);
+        m_target.text.append(digits, result.ptr);
     }
+
+    void finish() { m_target.line_begin.push_back(static_cast<uint32_t>(m_target.text.size())); }
+
+private:
+    SectionTemplate& m_target;
+    int64_t m_origin;
+};
+
+template <typename Sink>
+void write_note(Sink& out, const SightRead::Note& note) {
+    auto line = [&](int value, int64_t length) {
+        out.line(note.position.value());
+        out.put(" = N ");
+        out.put_int(value);
+        out.put(' ');
+        out.put_int(length);
+        out.put(LINE_END);
+    };
     
-    out << "}" << LINE_END;
+    // check each fret
+    for (int fret = 0; fret < 7; ++fret) {
+        if (note.lengths[fret].value() >= 0) {
+            line(fret, note.lengths[fret].value());
+        }
+    }
+    
+    // note flags
+    // n 5 = force (flip hopo/strum)
+    if (note.flags & (SightRead::FLAGS_FORCE_FLIP | SightRead::FLAGS_FORCE_HOPO | SightRead::FLAGS_FORCE_STRUM)) {
+        line(5, 0);
+    }
+    // n 6 = tap
+    if (note.flags & SightRead::FLAGS_TAP) {
+        line(6, 0);
+    }
+}
+
+template <typename Sink>
+void write_sp(Sink& out, const SightRead::StarPower& sp) {
+    out.line(sp.position.value());
+    out.put(" = S 2 ");
+    out.put_int(sp.length.value());
+    out.put(LINE_END);
+}
+
+// note_at(i)/sp_at(i) must both be in tick order
+template <typename Sink, typename NoteAt, typename SpAt>
+void merge_note_track(Sink& out,
+                      size_t note_count, NoteAt&& note_at,
+                      size_t sp_count, SpAt&& sp_at) {
+    // both streams are in tick order, clone hero wants them interspersed
+    // with notes first at the same tick
+    size_t sp = 0;
+    for (size_t i = 0; i < note_count; ++i) {
+        SightRead::Note note = note_at(i);
+        for (; sp < sp_count; ++sp) {
+            SightRead::StarPower phrase = sp_at(sp);
+            if (phrase.position >= note.position) break;
+            write_sp(out, phrase);
+        }
+        write_note(out, note);
+    }
+    for (; sp < sp_count; ++sp) {
+        write_sp(out, sp_at(sp));
+    }
 }
 
-void ChartWriter::write_note_track(std::ostream& out,
+// merge one step of a plan straight from its notes
+template <typename Sink>
+void merge_step(Sink& out, const LoopPlan& plan, const LoopStep& step) {
+    merge_note_track(out,
+                     step.emit_count, [&](size_t i) { return plan.note_at(step, i); },
+                     plan.unit(step).sp_phrases.size(), [&](size_t i) { return plan.sp_at(step, i); });
+}
+
+// One chunk of a parallel track write, same interface as ChartOutput
+class ChunkBuffer {
+public:
+    explicit ChunkBuffer(std::string& text) : m_text(text) { m_text.clear(); }
+
+    void line(int64_t tick) {
+        put(INDENT);
+        put_int(tick);
+    }
+    void put(char c) { m_text.push_back(c); }
+    void put(std::string_view str) { m_text.append(str); }
+    void put_int(int64_t value) {
+        char digits[20];
+        auto result = std::to_chars(digits, digits + sizeof(digits), value);
+        m_text.append(digits, result.ptr);
+    }
+
+private:
+    std::string& m_text;
+};
+
+// Template slot for a step, or -1 for the cut off last step which is only
+// written once and goes straight through the merge
+long template_index(const LoopPlan& plan, const LoopStep& step) {
+    const auto& unit = plan.unit(step);
+    if (step.emit_count < unit.notes.size()) return -1;
+
+    bool variant = step.fix_first_hopo && (unit.notes.front().flags & SightRead::FLAGS_HOPO);
+    return static_cast<long>(step.unit_index * 2 + (variant ? 1 : 0));
+}
+
+// Steps [begin, end) of a plan, templates must already be built. Steps cover
+// disjoint, increasing tick ranges, so this is the same as merging the
+// whole range at once.
+template <typename Sink>
+void write_steps(Sink& out, const LoopPlan& plan, const std::vector<SectionTemplate>& templates,
+                 size_t begin, size_t end) {
+    const auto& steps = plan.steps();
+    for (size_t s = begin; s < end; ++s) {
+        const auto& step = steps[s];
+        long index = template_index(plan, step);
+        if (index < 0) {
+            merge_step(out, plan, step);
+            continue;
+        }
+
+        const auto& section = templates[static_cast<size_t>(index)];
+        const int64_t offset = step.loop_offset.value();
+        for (size_t i = 0; i < section.ticks.size(); ++i) {
+            out.line(section.ticks[i] + offset);
+            out.put(std::string_view(section.text.data() + section.line_begin[i],
+                                     section.line_begin[i + 1] - section.line_begin[i]));
+        }
+    }
+}
+
+} // namespace
+
+void ChartWriter::write_note_track(ChartOutput& out,
                                     const std::string& track_name,
                                     const std::vector<SightRead::Note>& notes,
                                     const std::vector<SightRead::StarPower>& sp_phrases) {
-    out << "[" << track_name << "]" << LINE_END << "{" << LINE_END;
+    out.put('['); out.put(track_name); out.put(']'); out.put(LINE_END);
+    out.put('{'); out.put(LINE_END);
+    
+    auto by_position = [](const auto& a, const auto& b) { return a.position < b.position; };
+    if (std::is_sorted(notes.begin(), notes.end(), by_position) &&
+        std::is_sorted(sp_phrases.begin(), sp_phrases.end(), by_position)) {
+        merge_note_track(out,
+                         notes.size(), [&](size_t i) -> const SightRead::Note& { return notes[i]; },
+                         sp_phrases.size(), [&](size_t i) -> const SightRead::StarPower& { return sp_phrases[i]; });
+    } else {
+        write_unordered_events(out, notes, sp_phrases);
+    }
     
-    // build sorted event list (clone hero wants notes and sp interspersed)
-    struct TrackEvent {
-        int64_t tick;
-        int order;  // 0=note, 1=sp (notes first at same tick)
-        std::string line;
+    out.put('}'); out.put(LINE_END);
+}
+
+void ChartWriter::write_note_track(ChartOutput& out,
+                                    const std::string& track_name,
+                                    const LoopPlan& plan) {
+    out.put('['); out.put(track_name); out.put(']'); out.put(LINE_END);
+    out.put('{'); out.put(LINE_END);
+    
+    build_templates(plan);
+    
+    unsigned threads = m_thread_count;
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    
+    if (threads > 1 && plan.note_count() >= PARALLEL_MIN_NOTES) {
+        write_steps_parallel(out, plan, threads);
+    } else {
+        write_steps(out, plan, m_templates, 0, plan.steps().size());
+    }
+    
+    out.put('}'); out.put(LINE_END);
+}
+
+void ChartWriter::build_templates(const LoopPlan& plan) {
+    // every full copy of a unit is the same text apart from the ticks, so each
+    // unit is serialized once (twice if its first pass has the hopo->tap fix)
+    // and replayed with the step's offset added
+    if (m_templates.size() < plan.unit_count() * 2) {
+        m_templates.resize(plan.unit_count() * 2);
+    }
+    for (auto& section : m_templates) {
+        section.built = false;
+    }
+    
+    for (const auto& step : plan.steps()) {
+        long index = template_index(plan, step);
+        if (index < 0) continue;
+        
+        auto& section = m_templates[static_cast<size_t>(index)];
+        if (!section.built) {
+            TemplateRecorder recorder(section, step.loop_offset.value());
+            merge_step(recorder, plan, step);
+            recorder.finish();
+            section.built = true;
+        }
+    }
+}
+
+void ChartWriter::write_steps_parallel(ChartOutput& out, const LoopPlan& plan, unsigned threads) {
+    const auto& steps = plan.steps();
+    
+    // cut the steps into runs of roughly equal line counts
+    auto step_lines = [&](const LoopStep& step) {
+        long index = template_index(plan, step);
+        return index < 0 ? step.emit_count : m_templates[static_cast<size_t>(index)].ticks.size();
     };
-    std::vector<TrackEvent> events;
+    size_t total_lines = 0;
+    for (const auto& step : steps) {
+        total_lines += step_lines(step);
+    }
+    size_t lines_per_chunk = total_lines / (threads * CHUNKS_PER_THREAD) + 1;
+    
+    std::vector<std::pair<size_t, size_t>> ranges;
+    size_t chunk_begin = 0;
+    size_t chunk_lines = 0;
+    for (size_t s = 0; s < steps.size(); ++s) {
+        chunk_lines += step_lines(steps[s]);
+        if (chunk_lines >= lines_per_chunk || s + 1 == steps.size()) {
+            ranges.emplace_back(chunk_begin, s + 1);
+            chunk_begin = s + 1;
+            chunk_lines = 0;
+        }
+    }
+    
+    // each chunk formats into its own buffer, then they go out in order so
+    // the result is the same bytes as the serial path
+    if (m_chunks.size() < ranges.size()) {
+        m_chunks.resize(ranges.size());
+    }
+    
+    std::mutex error_mutex;
+    std::exception_ptr error;
+    {
+        JobPool pool(std::min<unsigned>(threads, static_cast<unsigned>(ranges.size())));
+        for (size_t c = 0; c < ranges.size(); ++c) {
+            pool.submit([&, c] {
+                try {
+                    ChunkBuffer chunk(m_chunks[c]);
+                    write_steps(chunk, plan, m_templates, ranges[c].first, ranges[c].second);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(error_mutex);
+                    if (!error) error = std::current_exception();
+                }
+            });
+        }
+        pool.wait();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    
+    out.put_chunks(m_chunks, ranges.size());
+}
+
+void ChartWriter::write_unordered_events(ChartOutput& out,
+                                         const std::vector<SightRead::Note>& notes,
+                                         const std::vector<SightRead::StarPower>& sp_phrases) {
+    // one event per line, keyed on (tick, order)
+    auto& events = m_events;
+    events.clear();
     
-    // notes
     for (const auto& note : notes) {
-        // check each fret
         for (int fret = 0; fret < 7; ++fret) {
             if (note.lengths[fret].value() >= 0) {
-                std::ostringstream ss;
-                ss << INDENT << note.position.value() << " = N " << fret << " " 
-                   << note.lengths[fret].value() << LINE_END;
-                events.push_back({note.position.value(), 0, ss.str()});
+                events.push_back({note.position.value(), 0, 'N', fret, note.lengths[fret].value()});
             }
         }
-        
-        // note flags
-        // n 5 = force (flip hopo/strum)
         if (note.flags & (SightRead::FLAGS_FORCE_FLIP | SightRead::FLAGS_FORCE_HOPO | SightRead::FLAGS_FORCE_STRUM)) {
-            std::ostringstream ss;
-            ss << INDENT << note.position.value() << " = N 5 0" << LINE_END;
-            events.push_back({note.position.value(), 0, ss.str()});
+            events.push_back({note.position.value(), 0, 'N', 5, 0});
         }
-        // n 6 = tap
         if (note.flags & SightRead::FLAGS_TAP) {
-            std::ostringstream ss;
-            ss << INDENT << note.position.value() << " = N 6 0" << LINE_END;
-            events.push_back({note.position.value(), 0, ss.str()});
+            events.push_back({note.position.value(), 0, 'N', 6, 0});
         }
     }
-    
-    // sp phrases
     for (const auto& sp : sp_phrases) {
-        std::ostringstream ss;
-        ss << INDENT << sp.position.value() << " = S 2 " << sp.length.value() << LINE_END;
-        events.push_back({sp.position.value(), 1, ss.str()});
+        events.push_back({sp.position.value(), 1, 'S', 2, sp.length.value()});
     }
     
-    // sort by tick then order
-    std::sort(events.begin(), events.end(), [](const TrackEvent& a, const TrackEvent& b) {
-        if (a.tick != b.tick) return a.tick < b.tick;
-        return a.order < b.order;
-    });
+    // lsd radix sort, a byte at a time: the order bit first, then the tick
+    // with its sign flipped so negative ticks sort first. stable, so lines of
+    // the same note keep their fret order
+    auto key_byte = [](const TrackEvent& event, int pass) -> unsigned {
+        if (pass == 0) return static_cast<unsigned>(event.order);
+        uint64_t tick = static_cast<uint64_t>(event.tick) ^ (uint64_t(1) << 63);
+        return static_cast<unsigned>((tick >> (8 * (pass - 1))) & 0xFF);
+    };
     
-    // write em
-    for (const auto& event : events) {
-        out << event.line;
+    m_sort_scratch.resize(events.size());
+    for (int pass = 0; pass <= 8; ++pass) {
+        size_t counts[257] = {};
+        for (const auto& event : events) {
+            ++counts[key_byte(event, pass) + 1];
+        }
+        // every event has the same byte here, nothing to do
+        if (std::find(std::begin(counts), std::end(counts), events.size()) != std::end(counts)) {
+            continue;
+        }
+        for (int i = 0; i < 256; ++i) {
+            counts[i + 1] += counts[i];
+        }
+        for (const auto& event : events) {
+            m_sort_scratch[counts[key_byte(event, pass)]++] = event;
+        }
+        events.swap(m_sort_scratch);
     }
     
-    out << "}" << LINE_END;
+    for (const auto& event : events) {
+        out.put(INDENT);
+        out.put_int(event.tick);
+        out.put(" = ");
+        out.put(event.type);
+        out.put(' ');
+        out.put_int(event.value);
+        out.put(' ');
+        out.put_int(event.length);
+        out.put(LINE_END);
+    }
 }
 
 std::string ChartWriter::instrument_difficulty_to_track_name(SightRead::Instrument inst,
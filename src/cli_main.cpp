@@ -0,0 +1,352 @@
+// headless batch generator, walks a song library and writes looped charts
+// for every (song, instrument, difficulty, target) on a worker pool
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "audio_jobs.hpp"
+#include "ini_parser.hpp"
+#include "job_pool.hpp"
+#include "loop_generator.hpp"
+#include "song_io.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+struct CliOptions {
+    std::string library_dir;
+    std::string output_dir;
+    std::vector<int> targets = {3999};
+    std::set<std::string> instruments;   // empty = every instrument in the song
+    std::set<std::string> difficulties = {"Expert"};
+    unsigned jobs = 0;
+    std::string ffmpeg_path;             // empty = charts only, no audio
+    bool fast_audio = false;
+    std::string audio_cache_dir;         // empty = decode every time
+    uint64_t audio_cache_mb = 4096;
+};
+
+void print_usage(const char* argv0) {
+    std::cerr
+        << "usage: " << argv0 << " [options] <library_dir> <output_dir>\n"
+        << "\n"
+        << "  --targets N[,N...]        note targets (default 3999)\n"
+        << "  --instruments A[,B...]    Guitar, Bass, Rhythm, Keys, Drums, GHLGuitar, GHLBass\n"
+        << "                            (default: every instrument in each song)\n"
+        << "  --difficulties A[,B...]   Easy, Medium, Hard, Expert (default Expert)\n"
+        << "  --jobs N                  worker threads (default: hardware threads)\n"
+        << "  --ffmpeg PATH             loop the song's audio into every chart folder\n"
+        << "                            with this ffmpeg (default: no audio)\n"
+        << "  --fast-audio              copy audio packets instead of re-encoding (or\n"
+        << "                            encode each section once and copy that),\n"
+        << "                            seams snap to the nearest packet\n"
+        << "  --audio-cache DIR         keep decoded audio here between targets and runs\n"
+        << "  --audio-cache-size MB     cache size before old entries go (default 4096)\n";
+}
+
+std::vector<std::string> split_list(const std::string& str) {
+    std::vector<std::string> result;
+    std::stringstream ss(str);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        item = NoteGen::trim(item);
+        if (!item.empty()) result.push_back(item);
+    }
+    return result;
+}
+
+bool parse_args(int argc, char** argv, CliOptions& options) {
+    std::vector<std::string> positional;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto next = [&]() -> std::string {
+            if (i + 1 >= argc) throw std::runtime_error("Missing value for " + arg);
+            return argv[++i];
+        };
+
+        if (arg == "-h" || arg == "--help") {
+            return false;
+        } else if (arg == "--targets") {
+            options.targets.clear();
+            for (const auto& t : split_list(next())) {
+                int target = std::stoi(t);
+                // same limits as the gui
+                options.targets.push_back(std::clamp(target, 100, 99999));
+            }
+        } else if (arg == "--instruments") {
+            auto list = split_list(next());
+            // string_to_instrument falls back to Guitar, so a name only counts
+            // if it comes back the same
+            for (const auto& name : list) {
+                if (NoteGen::instrument_to_string(NoteGen::string_to_instrument(name)) != name) {
+                    throw std::runtime_error("Unknown instrument: " + name);
+                }
+            }
+            options.instruments = std::set<std::string>(list.begin(), list.end());
+        } else if (arg == "--difficulties") {
+            auto list = split_list(next());
+            for (const auto& name : list) {
+                if (NoteGen::difficulty_to_string(NoteGen::string_to_difficulty(name)) != name) {
+                    throw std::runtime_error("Unknown difficulty: " + name);
+                }
+            }
+            options.difficulties = std::set<std::string>(list.begin(), list.end());
+        } else if (arg == "--jobs") {
+            options.jobs = static_cast<unsigned>(std::stoi(next()));
+        } else if (arg == "--ffmpeg") {
+            options.ffmpeg_path = next();
+        } else if (arg == "--fast-audio") {
+            options.fast_audio = true;
+        } else if (arg == "--audio-cache") {
+            options.audio_cache_dir = next();
+        } else if (arg == "--audio-cache-size") {
+            options.audio_cache_mb = std::stoull(next());
+        } else if (!arg.empty() && arg[0] == '-') {
+            throw std::runtime_error("Unknown option: " + arg);
+        } else {
+            positional.push_back(arg);
+        }
+    }
+
+    if (positional.size() != 2 || options.targets.empty()) {
+        return false;
+    }
+    options.library_dir = positional[0];
+    options.output_dir = positional[1];
+
+    std::sort(options.targets.begin(), options.targets.end());
+    options.targets.erase(std::unique(options.targets.begin(), options.targets.end()),
+                          options.targets.end());
+    return true;
+}
+
+// one chart per song folder, .chart wins over .mid if both are there
+std::vector<fs::path> find_songs(const fs::path& library_dir) {
+    std::map<fs::path, fs::path> by_folder;
+
+    for (const auto& entry : fs::recursive_directory_iterator(
+             library_dir, fs::directory_options::skip_permission_denied)) {
+        if (!entry.is_regular_file()) continue;
+        const auto& path = entry.path();
+        if (!NoteGen::is_chart_file(path.string())) continue;
+
+        auto it = by_folder.find(path.parent_path());
+        if (it == by_folder.end()) {
+            by_folder.emplace(path.parent_path(), path);
+        } else if (path.extension() == ".chart" && it->second.extension() != ".chart") {
+            it->second = path;
+        } else if (path.extension() == it->second.extension() && path < it->second) {
+            it->second = path;
+        }
+    }
+
+    std::vector<fs::path> songs;
+    for (const auto& [folder, chart] : by_folder) {
+        songs.push_back(chart);
+    }
+    return songs;
+}
+
+class BatchRunner {
+public:
+    BatchRunner(const CliOptions& options) : m_options(options), m_pool(options.jobs) {
+        if (!options.audio_cache_dir.empty()) {
+            m_pcm_cache = std::make_unique<NoteGen::PcmCache>(options.audio_cache_dir,
+                                                              options.audio_cache_mb << 20);
+        }
+    }
+
+    int run(const std::vector<fs::path>& songs) {
+        for (const auto& chart_path : songs) {
+            m_pool.submit([this, chart_path] { load_song_and_queue(chart_path); });
+        }
+        m_pool.wait();
+
+        std::lock_guard<std::mutex> lock(m_log_mutex);
+        std::cout << "Generated " << m_succeeded << " charts, "
+                  << m_failed << " failed (" << songs.size() << " songs, "
+                  << m_pool.size() << " workers)" << std::endl;
+        // nothing generated is a failure too, none of the songs had a wanted track
+        return m_failed > 0 || m_succeeded == 0 ? 1 : 0;
+    }
+
+private:
+    void log(const std::string& line, bool error = false) {
+        std::lock_guard<std::mutex> lock(m_log_mutex);
+        (error ? std::cerr : std::cout) << line << std::endl;
+    }
+
+    void load_song_and_queue(const fs::path& chart_path) {
+        // only parse the tracks we're going to generate
+        std::set<SightRead::Instrument> instruments;
+        for (const auto& name : m_options.instruments) {
+            instruments.insert(NoteGen::string_to_instrument(name));
+        }
+        std::set<SightRead::Difficulty> difficulties;
+        for (const auto& name : m_options.difficulties) {
+            difficulties.insert(NoteGen::string_to_difficulty(name));
+        }
+
+        std::shared_ptr<const SightRead::Song> song;
+        try {
+            // the pool already keeps every core busy, convert tracks on this worker
+            song = NoteGen::load_song(chart_path.string(), instruments, difficulties, 1);
+        } catch (const std::exception& e) {
+            ++m_failed;
+            log("FAIL " + chart_path.string() + ": " + e.what(), true);
+            return;
+        }
+
+        auto ini_path = chart_path.parent_path() / "song.ini";
+        auto ini_data = std::make_shared<const NoteGen::SongIniData>(
+            fs::exists(ini_path) ? NoteGen::parse_song_ini(ini_path.string()) : NoteGen::SongIniData{});
+
+        auto relative = fs::relative(chart_path.parent_path(), m_options.library_dir);
+        fs::path song_output = fs::path(m_options.output_dir) / relative;
+
+        for (auto instrument : song->instruments()) {
+            auto inst_name = NoteGen::instrument_to_string(instrument);
+            if (!m_options.instruments.empty() && !m_options.instruments.count(inst_name)) continue;
+
+            for (auto difficulty : song->difficulties(instrument)) {
+                auto diff_name = NoteGen::difficulty_to_string(difficulty);
+                if (!m_options.difficulties.count(diff_name)) continue;
+
+                // all targets of a track share one loop plan, so one job per track
+                fs::path track_output = song_output / (inst_name + "_" + diff_name);
+                m_pool.submit([=, this] {
+                    generate_track(song, ini_data, instrument, difficulty, chart_path.parent_path(), track_output);
+                });
+            }
+        }
+    }
+
+    void generate_track(const std::shared_ptr<const SightRead::Song>& song,
+                        const std::shared_ptr<const NoteGen::SongIniData>& ini_data,
+                        SightRead::Instrument instrument,
+                        SightRead::Difficulty difficulty,
+                        const fs::path& song_dir,
+                        const fs::path& track_output) {
+        std::vector<NoteGen::GenerationResult> results;
+        try {
+            NoteGen::LoopGenerator generator(*song, instrument, difficulty, *ini_data);
+            results = generator.generate(NoteGen::GenerationConfig{}, m_options.targets);
+        } catch (const std::exception& e) {
+            m_failed += static_cast<int>(m_options.targets.size());
+            log("FAIL " + track_output.string() + ": " + e.what(), true);
+            return;
+        }
+
+        // results come back in ascending target order, same as m_options.targets
+        for (size_t i = 0; i < results.size(); ++i) {
+            const auto& result = results[i];
+            std::string label = track_output.string() + " @" + std::to_string(m_options.targets[i]);
+
+            if (!result.success) {
+                ++m_failed;
+                log("FAIL " + label + ": " + result.error_message, true);
+                continue;
+            }
+
+            try {
+                auto final_output = track_output / result.folder_name;
+                // the pool already keeps every core busy, write each chart on its own worker
+                NoteGen::write_generated_chart(final_output.string(), result, *song, *ini_data, 1);
+                if (!m_options.ffmpeg_path.empty()) {
+                    loop_audio(result, song_dir, final_output);
+                }
+
+                ++m_succeeded;
+                log("OK   " + final_output.string());
+            } catch (const std::exception& e) {
+                ++m_failed;
+                log("FAIL " + label + ": " + e.what(), true);
+            }
+        }
+    }
+
+    // a stem that cant be looped is copied as is so the chart still plays,
+    // same as the gui
+    void loop_audio(const NoteGen::GenerationResult& result, const fs::path& song_dir, const fs::path& final_output) {
+        std::vector<NoteGen::StemJob> stems;
+        for (const auto& entry : fs::directory_iterator(song_dir)) {
+            if (entry.is_regular_file() && NoteGen::is_audio_file(entry.path().string())) {
+                stems.push_back({entry.path().string(), (final_output / entry.path().filename()).string()});
+            }
+        }
+        if (stems.empty() || result.audio_timeline.empty()) return;
+
+        NoteGen::StemOptions audio_options;
+        audio_options.fade_out = result.is_full_song;
+        audio_options.stream_copy = m_options.fast_audio;
+        audio_options.max_jobs = 1;  // the pool already keeps every core busy
+        audio_options.cache = m_pcm_cache.get();
+
+        NoteGen::StemProgress progress(stems.size());
+        auto stem_results = NoteGen::process_stems(m_options.ffmpeg_path, stems, result.audio_timeline,
+                                                   audio_options, progress);
+
+        for (size_t i = 0; i < stems.size(); ++i) {
+            if (stem_results[i].state == NoteGen::StemState::Done) continue;
+            log("WARN " + stems[i].dest_path + ": " + stem_results[i].error + ", copied unlooped", true);
+            std::error_code ignored;
+            fs::copy_file(stems[i].source_path, stems[i].dest_path, fs::copy_options::overwrite_existing, ignored);
+        }
+    }
+
+    const CliOptions& m_options;
+    std::unique_ptr<NoteGen::PcmCache> m_pcm_cache;
+    NoteGen::JobPool m_pool;
+    std::mutex m_log_mutex;
+    std::atomic<int> m_succeeded{0};
+    std::atomic<int> m_failed{0};
+};
+
+} // namespace
+
+int main(int argc, char** argv) {
+    CliOptions options;
+    try {
+        if (!parse_args(argc, argv, options)) {
+            print_usage(argv[0]);
+            return 2;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        print_usage(argv[0]);
+        return 2;
+    }
+
+    if (!fs::is_directory(options.library_dir)) {
+        std::cerr << "Not a directory: " << options.library_dir << std::endl;
+        return 2;
+    }
+
+    std::vector<fs::path> songs;
+    try {
+        songs = find_songs(options.library_dir);
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to scan library: " << e.what() << std::endl;
+        return 1;
+    }
+
+    if (songs.empty()) {
+        std::cerr << "No charts found in " << options.library_dir << std::endl;
+        return 1;
+    }
+
+    BatchRunner runner(options);
+    return runner.run(songs);
+}
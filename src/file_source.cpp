@@ -0,0 +1,47 @@
+#include "file_source.hpp"
+#include <fstream>
+#include <stdexcept>
+
+namespace NoteGen {
+
+FileSource::FileSource(const std::string& path) {
+    try {
+        m_mapped = std::make_unique<MappedFile>(path);
+        // procfs files claim to be empty, so an empty map is read to be sure
+        if (m_mapped->size() > 0) {
+            m_data = m_mapped->view();
+            return;
+        }
+        m_mapped.reset();
+    } catch (const std::runtime_error&) {
+        // some network shares and special files won't map, read it instead
+    }
+
+    // read to the end in blocks, pipes can't tell their size up front
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Cannot open file: " + path);
+    }
+    constexpr size_t block_size = 64 * 1024;
+    while (file) {
+        size_t used = m_buffer.size();
+        m_buffer.resize(used + block_size);
+        file.read(m_buffer.data() + used, static_cast<std::streamsize>(block_size));
+        m_buffer.resize(used + static_cast<size_t>(file.gcount()));
+    }
+    if (file.bad()) {
+        throw std::runtime_error("Cannot read file: " + path);
+    }
+    m_data = m_buffer;
+}
+
+std::string_view FileSource::text() const {
+    constexpr std::string_view utf8_bom = "\xEF\xBB\xBF";
+    std::string_view text = m_data;
+    if (text.starts_with(utf8_bom)) {
+        text.remove_prefix(utf8_bom.size());
+    }
+    return text;
+}
+
+} // namespace NoteGen
@@ -0,0 +1,73 @@
+#include "job_pool.hpp"
+#include <algorithm>
+
+namespace NoteGen {
+
+JobPool::JobPool(unsigned thread_count) {
+    if (thread_count == 0) {
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    m_workers.reserve(thread_count);
+    for (unsigned i = 0; i < thread_count; ++i) {
+        m_workers.emplace_back([this] { worker_loop(); });
+    }
+}
+
+JobPool::~JobPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_job_ready.notify_all();
+
+    for (auto& worker : m_workers) {
+        worker.join();
+    }
+}
+
+void JobPool::submit(std::function<void()> job) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_jobs.push_back(std::move(job));
+    }
+    m_job_ready.notify_one();
+}
+
+void JobPool::wait() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle.wait(lock, [this] { return m_jobs.empty() && m_active == 0; });
+}
+
+void JobPool::worker_loop() {
+    while (true) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_job_ready.wait(lock, [this] { return m_stopping || !m_jobs.empty(); });
+
+            // drain whats left before stopping so wait() never hangs
+            if (m_jobs.empty()) return;
+
+            job = std::move(m_jobs.front());
+            m_jobs.pop_front();
+            ++m_active;
+        }
+
+        // jobs report their own errors, dont let one take down the pool
+        try {
+            job();
+        } catch (...) {
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            --m_active;
+            if (m_jobs.empty() && m_active == 0) {
+                m_idle.notify_all();
+            }
+        }
+    }
+}
+
+} // namespace NoteGen
@@ -1,6 +1,6 @@
 #include "loop_generator.hpp"
 #include <algorithm>
-#include <sstream>
+#include <limits>
 #include <set>
 
 namespace NoteGen {
@@ -81,22 +81,39 @@ SightRead::Tick LoopGenerator::get_section_end(size_t section_index) const {
 
 int LoopGenerator::count_notes_in_range(SightRead::Tick start, SightRead::Tick end) const {
     if (!m_track) return 0;
-    
-    int count = 0;
-    for (const auto& note : m_track->notes()) {
-        if (note.position >= start && note.position < end) {
-            ++count;
-        }
-    }
-    return count;
+    return m_track->note_count_in_range(start, end);
+}
+
+void write_chart(std::ostream& out, const GenerationResult& result, ChartWriter& writer) {
+    writer.write(out, result.metadata, result.sync_events, result.looped_sections,
+                 result.instrument, result.difficulty, result.plan);
 }
 
 GenerationResult LoopGenerator::generate(const GenerationConfig& config) {
-    GenerationResult result;
+    return generate(config, {config.target_note_count}).front();
+}
+
+std::vector<GenerationResult> LoopGenerator::generate(const GenerationConfig& config,
+                                                      std::vector<int> target_note_counts) {
+    std::sort(target_note_counts.begin(), target_note_counts.end());
+    target_note_counts.erase(std::unique(target_note_counts.begin(), target_note_counts.end()),
+                             target_note_counts.end());
+    
+    std::vector<GenerationResult> results;
+    if (target_note_counts.empty()) {
+        return results;
+    }
+    
+    auto fail_all = [&](const std::string& message) {
+        results.assign(target_note_counts.size(), GenerationResult{});
+        for (auto& result : results) {
+            result.error_message = message;
+        }
+        return results;
+    };
     
     if (!m_track) {
-        result.error_message = "Track not found for selected instrument/difficulty";
-        return result;
+        return fail_all("Track not found for selected instrument/difficulty");
     }
     
     // get sections to loop
@@ -118,31 +135,19 @@ GenerationResult LoopGenerator::generate(const GenerationConfig& config) {
     }
     
     if (sections_to_loop.empty()) {
-        result.error_message = "No sections selected";
-        return result;
+        return fail_all("No sections selected");
     }
     
-    // generate looped notes
     // full song if all sections selected
     bool is_full_song = config.selected_sections.empty() || 
                         (sections_to_loop.size() == all_sections.size());
     
-    std::vector<SightRead::StarPower> sp_phrases;
-    auto looped_notes = generate_looped_notes(
-        sections_to_loop, 
-        config.target_note_count,
-        result.looped_sections,
-        result.audio_segments,
-        result.sync_events,
-        sp_phrases,
-        is_full_song
-    );
-    
-    result.total_notes = static_cast<int>(looped_notes.size());
-    
-    // calc total duration
-    for (const auto& seg : result.audio_segments) {
-        result.total_duration_seconds += seg.duration_seconds * seg.repeat_count;
+    // units are shared by every target, each target only adds its own list of steps
+    auto units = std::make_shared<const std::vector<LoopUnit>>(
+        build_loop_units(sections_to_loop, is_full_song));
+    
+    if (plan_loop(units, target_note_counts.back()).empty()) {
+        return fail_all("Selected sections contain no notes");
     }
     
     // build chart name (prefer song.ini over chart metadata)
@@ -150,13 +155,9 @@ GenerationResult LoopGenerator::generate(const GenerationConfig& config) {
     std::string artist = !m_ini_data.artist.empty() ? m_ini_data.artist : m_song.global_data().artist();
     std::string charter = !m_ini_data.charter.empty() ? m_ini_data.charter : m_song.global_data().charter();
     
-    std::string chart_name;
-    std::string folder_name;  // For ZIP filename
-    if (is_full_song) {
-        // full song format
-        chart_name = std::to_string(result.total_notes) + " - " + song_name;
-        folder_name = std::to_string(result.total_notes) + "_" + song_name;
-    } else {
+    std::string section_names;
+    std::string section_names_sanitized;
+    if (!is_full_song) {
         // selected sections format
         auto replace_underscores = [](std::string str) {
             std::replace(str.begin(), str.end(), '_', ' ');
@@ -179,8 +180,6 @@ GenerationResult LoopGenerator::generate(const GenerationConfig& config) {
             return result;
         };
         
-        std::string section_names;
-        std::string section_names_sanitized;
         for (size_t i = 0; i < sections_to_loop.size(); ++i) {
             if (i > 0) {
                 section_names += ", ";
@@ -194,357 +193,258 @@ GenerationResult LoopGenerator::generate(const GenerationConfig& config) {
                 break;
             }
         }
-        chart_name = std::to_string(result.total_notes) + " " + section_names + " - " + song_name;
-        folder_name = std::to_string(result.total_notes) + "_" + section_names_sanitized;
     }
-    result.folder_name = folder_name;
-    result.chart_name = chart_name;
-    
-    ChartMetadata metadata;
-    metadata.name = chart_name;
-    metadata.artist = artist;
-    metadata.charter = charter;
-    metadata.resolution = m_song.global_data().resolution();
     
-    std::map<std::pair<SightRead::Instrument, SightRead::Difficulty>, 
-             std::vector<SightRead::Note>> tracks;
-    tracks[{m_instrument, m_difficulty}] = looped_notes;
+    const int resolution = m_song.global_data().resolution();
     
-    std::ostringstream chart_stream;
-    ChartWriter writer;
-    writer.write(chart_stream, metadata, result.sync_events, result.looped_sections, tracks, sp_phrases);
+    for (int target : target_note_counts) {
+        GenerationResult result;
+        result.plan = plan_loop(units, target);
+        
+        result.looped_sections = result.plan.looped_sections();
+        result.sync_events = result.plan.sync_events(resolution);
+        result.audio_timeline = result.plan.audio_timeline();
+        result.total_notes = static_cast<int>(result.plan.note_count());
+        
+        // calc total duration
+        for (const auto& block : result.audio_timeline) {
+            for (const auto& seg : block.segments) {
+                result.total_duration_seconds += seg.duration_seconds * seg.repeat_count * block.repeat_count;
+            }
+        }
+        
+        if (is_full_song) {
+            // full song format
+            result.chart_name = std::to_string(result.total_notes) + " - " + song_name;
+            result.folder_name = std::to_string(result.total_notes) + "_" + song_name;
+        } else {
+            result.chart_name = std::to_string(result.total_notes) + " " + section_names + " - " + song_name;
+            result.folder_name = std::to_string(result.total_notes) + "_" + section_names_sanitized;
+        }
+        
+        result.metadata.name = result.chart_name;
+        result.metadata.artist = artist;
+        result.metadata.charter = charter;
+        result.metadata.resolution = resolution;
+        result.instrument = m_instrument;
+        result.difficulty = m_difficulty;
+        result.is_full_song = is_full_song;
+        result.success = true;
+        
+        results.push_back(std::move(result));
+    }
     
-    result.chart_data = chart_stream.str();
-    result.is_full_song = is_full_song;
-    result.success = true;
+    return results;
+}
+
+void LoopGenerator::append_tempo_events(SightRead::Tick start, SightRead::Tick end,
+                                        SightRead::Tick origin,
+                                        std::vector<SyncTrackEvent>& out_events) const {
+    const auto& tempo_map = m_song.global_data().tempo_map();
+    const auto& time_sigs = tempo_map.time_sigs();
+    const auto& bpms = tempo_map.bpms();
     
-    return result;
+    // both lists are sorted, merge them so the result is in position order
+    // (time sig first when they share a tick)
+    auto ts = time_sigs.begin();
+    auto bpm = bpms.begin();
+    while (ts != time_sigs.end() || bpm != bpms.end()) {
+        bool take_ts = bpm == bpms.end() || (ts != time_sigs.end() && ts->position <= bpm->position);
+        
+        SyncTrackEvent event;
+        if (take_ts) {
+            event.position = ts->position;
+            event.is_bpm = false;
+            event.ts_num = ts->numerator;
+            event.ts_denom = ts->denominator;
+            ++ts;
+        } else {
+            event.position = bpm->position;
+            event.is_bpm = true;
+            event.bpm = bpm->bpm;
+            ++bpm;
+        }
+        
+        if (event.position >= start && event.position < end) {
+            event.position = event.position - origin;
+            out_events.push_back(event);
+        }
+    }
 }
 
-std::vector<SightRead::Note> LoopGenerator::generate_looped_notes(
+std::vector<LoopUnit> LoopGenerator::build_loop_units(
     const std::vector<SectionInfo>& sections_to_loop,
-    int target_notes,
-    std::vector<LoopedSection>& out_looped_sections,
-    std::vector<GenerationResult::AudioSegment>& out_audio_segments,
-    std::vector<SyncTrackEvent>& out_sync_events,
-    std::vector<SightRead::StarPower>& out_sp_phrases,
-    bool is_full_song) {
-    
-    std::vector<SightRead::Note> result;
+    bool is_full_song) const {
+    
+    std::vector<LoopUnit> units;
     const auto& tempo_map = m_song.global_data().tempo_map();
-    const auto& original_sp = m_track->sp_phrases();
+    const auto& time_sigs = tempo_map.time_sigs();
+    const auto& bpms = tempo_map.bpms();
     
-    SightRead::Tick current_tick(0);
-    int current_notes = 0;
-    int full_loop_count = 0;
+    auto display_name_of = [](std::string name) {
+        std::replace(name.begin(), name.end(), '_', ' ');
+        return name;
+    };
     
     if (is_full_song) {
         // full song mode: loop entire song from tick 0
-        SightRead::Tick song_start(0);
-        SightRead::Tick song_end = sections_to_loop.back().end;
-        SightRead::Tick full_pass_duration = song_end - song_start;
+        LoopUnit unit;
+        unit.source_start = SightRead::Tick(0);
+        unit.source_end = sections_to_loop.back().end;
+        
+        // get all notes and sp phrases
+        SightRead::Tick track_start(std::numeric_limits<int>::min());
+        unit.notes = m_track->notes_in_range(track_start, unit.source_end);
+        unit.sp_phrases = m_track->sp_phrases_in_range(track_start, unit.source_end);
+        
+        // whole sync track up to the song end
+        append_tempo_events(track_start, unit.source_end, unit.source_start, unit.sync_events);
+        
+        // section markers
+        for (const auto& section : sections_to_loop) {
+            LoopedSection marker;
+            marker.name = display_name_of(section.name);
+            marker.start = section.start;
+            marker.end = section.end;
+            marker.loop_count = 1;
+            marker.note_count = section.note_count;
+            unit.markers.push_back(marker);
+        }
         
         // audio from 0 to end of last section
-        double full_pass_audio_start = 0.0;
-        double full_pass_audio_end = tempo_map.to_seconds(song_end).value();
-        double full_pass_audio_duration = full_pass_audio_end;
+        unit.audio_start_seconds = 0.0;
+        unit.audio_duration_seconds = tempo_map.to_seconds(unit.source_end).value();
         
-        // get all notes
-        std::vector<SightRead::Note> all_notes;
-        for (const auto& note : m_track->notes()) {
-            if (note.position < song_end) {
-                all_notes.push_back(note);
-            }
+        if (!unit.notes.empty()) {
+            units.push_back(std::move(unit));
         }
+        return units;
+    }
+    
+    // selected sections mode: loop each section individually
+    // last tempo event at or before a tick, or the first one if theres none
+    auto initial_index = [](const auto& events, SightRead::Tick tick) {
+        auto it = std::upper_bound(events.begin(), events.end(), tick,
+                                   [](SightRead::Tick t, const auto& ev) { return t < ev.position; });
+        return it == events.begin() ? size_t(0) : static_cast<size_t>(it - events.begin()) - 1;
+    };
+    
+    // track processed sections for hopo->tap on first occurrence
+    std::set<std::string> processed_sections;
+    
+    for (const auto& section : sections_to_loop) {
+        LoopUnit unit;
+        unit.source_start = section.start;
+        unit.source_end = section.end;
+        unit.notes = m_track->notes_in_range(section.start, section.end);
         
-        // get all sp phrases
-        std::vector<SightRead::StarPower> all_sp;
-        for (const auto& sp : original_sp) {
-            if (sp.position < song_end) {
-                all_sp.push_back(sp);
-            }
+        // empty sections are skipped entirely
+        if (unit.notes.empty()) continue;
+        
+        unit.sp_phrases = m_track->sp_phrases_in_range(section.start, section.end);
+        
+        // initial time sig and bpm at the section start
+        if (!time_sigs.empty()) {
+            const auto& ts = time_sigs[initial_index(time_sigs, section.start)];
+            SyncTrackEvent ts_event;
+            ts_event.position = SightRead::Tick(0);
+            ts_event.is_bpm = false;
+            ts_event.ts_num = ts.numerator;
+            ts_event.ts_denom = ts.denominator;
+            unit.sync_events.push_back(ts_event);
+        }
+        if (!bpms.empty()) {
+            SyncTrackEvent bpm_event;
+            bpm_event.position = SightRead::Tick(0);
+            bpm_event.is_bpm = true;
+            bpm_event.bpm = bpms[initial_index(bpms, section.start)].bpm;
+            unit.sync_events.push_back(bpm_event);
         }
         
-        while (current_notes < target_notes) {
-            ++full_loop_count;
-            
-            SightRead::Tick loop_offset = current_tick;
-            
-            // sync track events for this loop
-            for (const auto& ts : tempo_map.time_sigs()) {
-                if (ts.position < song_end) {
-                    SyncTrackEvent event;
-                    event.position = SightRead::Tick(ts.position.value() + loop_offset.value());
-                    event.is_bpm = false;
-                    event.ts_num = ts.numerator;
-                    event.ts_denom = ts.denominator;
-                    out_sync_events.push_back(event);
-                }
-            }
-            for (const auto& bpm : tempo_map.bpms()) {
-                if (bpm.position < song_end) {
-                    SyncTrackEvent event;
-                    event.position = SightRead::Tick(bpm.position.value() + loop_offset.value());
-                    event.is_bpm = true;
-                    event.bpm = bpm.bpm;
-                    out_sync_events.push_back(event);
-                }
-            }
-            
-            // sp phrases with offset
-            for (const auto& sp : all_sp) {
-                out_sp_phrases.push_back({
-                    SightRead::Tick(sp.position.value() + loop_offset.value()),
-                    sp.length
-                });
-            }
-            
-            // section markers
-            for (const auto& section : sections_to_loop) {
-                std::string display_name = section.name;
-                std::replace(display_name.begin(), display_name.end(), '_', ' ');
-                
-                LoopedSection looped_sec;
-                looped_sec.name = display_name + " " + std::to_string(full_loop_count);
-                // add loop offset to section position
-                looped_sec.start = SightRead::Tick(section.start.value() + loop_offset.value());
-                looped_sec.end = SightRead::Tick(section.end.value() + loop_offset.value());
-                looped_sec.loop_count = 1;
-                looped_sec.note_count = section.note_count;
-                out_looped_sections.push_back(looped_sec);
-            }
-            
-            // add notes
-            SightRead::Tick last_note_tick = loop_offset;
-            int notes_this_loop = 0;
+        // tempo/ts changes within section (the ones at the start are covered above)
+        append_tempo_events(section.start + SightRead::Tick(1), section.end, section.start, unit.sync_events);
+        
+        // section marker
+        LoopedSection marker;
+        marker.name = display_name_of(section.name);
+        marker.start = SightRead::Tick(0);
+        marker.end = section.end - section.start;
+        marker.loop_count = 1;
+        marker.note_count = static_cast<int>(unit.notes.size());
+        unit.markers.push_back(marker);
+        
+        unit.audio_start_seconds = tempo_map.to_seconds(section.start).value();
+        unit.audio_duration_seconds = section.duration_seconds;
+        
+        // check if first time processing this section
+        unit.fix_first_hopo = processed_sections.insert(section.name).second;
+        
+        units.push_back(std::move(unit));
+    }
+    
+    return units;
+}
+
+LoopPlan LoopGenerator::plan_loop(std::shared_ptr<const std::vector<LoopUnit>> units,
+                                  int target_notes) const {
+    std::vector<LoopStep> steps;
+    const auto& tempo_map = m_song.global_data().tempo_map();
+    
+    size_t pass_notes = 0;
+    int pass_ticks = 0;
+    for (const auto& unit : *units) {
+        pass_notes += unit.notes.size();
+        pass_ticks += (unit.source_end - unit.source_start).value();
+    }
+    
+    // nothing to loop, would never reach the target
+    if (pass_notes == 0 || target_notes <= 0) {
+        return LoopPlan();
+    }
+    
+    // passes fully emitted before the last one, and where the last one stops
+    size_t target = static_cast<size_t>(target_notes);
+    size_t full_passes = (target - 1) / pass_notes;
+    size_t remaining = target - full_passes * pass_notes;
+    
+    size_t last_unit = 0;
+    for (size_t notes = 0; last_unit < units->size(); ++last_unit) {
+        notes += (*units)[last_unit].notes.size();
+        if (notes >= remaining) break;
+    }
+    
+    steps.reserve(full_passes * units->size() + last_unit + 1);
+    
+    for (size_t pass = 0; pass <= full_passes; ++pass) {
+        size_t unit_count = (pass == full_passes) ? last_unit + 1 : units->size();
+        size_t notes_begin = pass * pass_notes;
+        int loop_offset = static_cast<int>(pass) * pass_ticks;
+        
+        for (size_t i = 0; i < unit_count; ++i) {
+            const auto& unit = (*units)[i];
             
-            for (const auto& note : all_notes) {
-                if (current_notes >= target_notes) break;
-                
-                SightRead::Note new_note = note;
-                // offset note position
-                new_note.position = SightRead::Tick(note.position.value() + loop_offset.value());
-                result.push_back(new_note);
-                last_note_tick = new_note.position;
-                ++current_notes;
-                ++notes_this_loop;
-            }
+            LoopStep step;
+            step.unit_index = i;
+            step.pass = static_cast<int>(pass) + 1;
+            step.notes_begin = notes_begin;
+            step.emit_count = std::min(unit.notes.size(), target - notes_begin);
+            step.loop_offset = SightRead::Tick(loop_offset);
+            step.fix_first_hopo = unit.fix_first_hopo && pass == 0;
+            step.audio_duration_seconds = unit.audio_duration_seconds;
             
-            // Audio segment
-            double audio_duration;
-            if (current_notes >= target_notes && notes_this_loop < static_cast<int>(all_notes.size())) {
-                // partial loop - time of last note relative to loop start
-                SightRead::Tick relative_last = SightRead::Tick(last_note_tick.value() - loop_offset.value());
-                audio_duration = tempo_map.to_seconds(relative_last).value() + 0.5;
-            } else {
-                audio_duration = full_pass_audio_duration;
+            if (step.emit_count < unit.notes.size()) {
+                // partial - time of last note where the step was copied from
+                SightRead::Tick last = unit.notes[step.emit_count - 1].position;
+                step.audio_duration_seconds = tempo_map.to_seconds(last).value() - unit.audio_start_seconds + 0.5;
             }
+            steps.push_back(step);
             
-            GenerationResult::AudioSegment audio_seg;
-            audio_seg.start_seconds = full_pass_audio_start;  // Always 0 for full song
-            audio_seg.duration_seconds = audio_duration;
-            audio_seg.repeat_count = 1;
-            out_audio_segments.push_back(audio_seg);
-            
-            current_tick = current_tick + full_pass_duration;
-        }
-    } else {
-        // selected sections mode: loop each section individually
-        // track processed sections for hopo->tap on first occurrence
-        std::set<std::string> processed_sections;
-        bool first_section_processed = false;
-        
-        while (current_notes < target_notes) {
-            ++full_loop_count;
-            
-            for (const auto& section : sections_to_loop) {
-                if (current_notes >= target_notes) break;
-                
-                // get notes in section
-                std::vector<SightRead::Note> section_notes;
-                for (const auto& note : m_track->notes()) {
-                    if (note.position >= section.start && note.position < section.end) {
-                        section_notes.push_back(note);
-                    }
-                }
-                
-                if (section_notes.empty()) continue;
-                
-                // get sp in section
-                std::vector<SightRead::StarPower> section_sp;
-                for (const auto& sp : original_sp) {
-                    if (sp.position >= section.start && sp.position < section.end) {
-                        section_sp.push_back(sp);
-                    }
-                }
-                
-                SightRead::Tick section_duration = section.end - section.start;
-                SightRead::Tick loop_offset = current_tick;
-                SightRead::Tick original_offset = section.start;
-                
-                // tempo/time sig events for this section
-                // find initial time sig (last ts before or at section start)
-                int init_ts_idx = 0;
-                for (size_t i = 0; i < tempo_map.time_sigs().size(); ++i) {
-                    if (tempo_map.time_sigs()[i].position <= section.start) {
-                        init_ts_idx = static_cast<int>(i);
-                    }
-                }
-                if (!tempo_map.time_sigs().empty()) {
-                    SyncTrackEvent ts_event;
-                    ts_event.position = loop_offset;
-                    ts_event.is_bpm = false;
-                    ts_event.ts_num = tempo_map.time_sigs()[init_ts_idx].numerator;
-                    ts_event.ts_denom = tempo_map.time_sigs()[init_ts_idx].denominator;
-                    // Only add if this is a new position or different value
-                    bool should_add = out_sync_events.empty();
-                    if (!should_add) {
-                        // check if already have ts at this position
-                        bool found = false;
-                        for (const auto& ev : out_sync_events) {
-                            if (!ev.is_bpm && ev.position == loop_offset) {
-                                found = true;
-                                break;
-                            }
-                        }
-                        should_add = !found;
-                    }
-                    if (should_add) {
-                        out_sync_events.push_back(ts_event);
-                    }
-                }
-                
-                // find initial bpm
-                int init_bpm_idx = 0;
-                for (size_t i = 0; i < tempo_map.bpms().size(); ++i) {
-                    if (tempo_map.bpms()[i].position <= section.start) {
-                        init_bpm_idx = static_cast<int>(i);
-                    }
-                }
-                if (!tempo_map.bpms().empty()) {
-                    SyncTrackEvent bpm_event;
-                    bpm_event.position = loop_offset;
-                    bpm_event.is_bpm = true;
-                    bpm_event.bpm = tempo_map.bpms()[init_bpm_idx].bpm;
-                    // Only add if this is a new position or different value
-                    bool should_add = out_sync_events.empty();
-                    if (!should_add) {
-                        bool found = false;
-                        for (const auto& ev : out_sync_events) {
-                            if (ev.is_bpm && ev.position == loop_offset) {
-                                found = true;
-                                break;
-                            }
-                        }
-                        should_add = !found;
-                    }
-                    if (should_add) {
-                        out_sync_events.push_back(bpm_event);
-                    }
-                }
-                
-                // tempo/ts changes within section
-                for (const auto& ts : tempo_map.time_sigs()) {
-                    if (ts.position > section.start && ts.position < section.end) {
-                        SyncTrackEvent ts_event;
-                        ts_event.position = SightRead::Tick(ts.position.value() - original_offset.value() + loop_offset.value());
-                        ts_event.is_bpm = false;
-                        ts_event.ts_num = ts.numerator;
-                        ts_event.ts_denom = ts.denominator;
-                        out_sync_events.push_back(ts_event);
-                    }
-                }
-                
-                for (const auto& bpm : tempo_map.bpms()) {
-                    if (bpm.position > section.start && bpm.position < section.end) {
-                        SyncTrackEvent bpm_event;
-                        bpm_event.position = SightRead::Tick(bpm.position.value() - original_offset.value() + loop_offset.value());
-                        bpm_event.is_bpm = true;
-                        bpm_event.bpm = bpm.bpm;
-                        out_sync_events.push_back(bpm_event);
-                    }
-                }
-                
-                first_section_processed = true;
-                
-                // section marker
-                std::string display_name = section.name;
-                std::replace(display_name.begin(), display_name.end(), '_', ' ');
-                
-                LoopedSection looped_sec;
-                looped_sec.name = display_name + " " + std::to_string(full_loop_count);
-                looped_sec.start = loop_offset;
-                looped_sec.end = loop_offset + section_duration;
-                looped_sec.loop_count = 1;
-                looped_sec.note_count = static_cast<int>(section_notes.size());
-                out_looped_sections.push_back(looped_sec);
-                
-                // sp phrases with offset
-                for (const auto& sp : section_sp) {
-                    out_sp_phrases.push_back({
-                        SightRead::Tick(sp.position.value() - original_offset.value() + loop_offset.value()),
-                        sp.length
-                    });
-                }
-                
-                // check if first time processing this section
-                bool is_first_occurrence = (processed_sections.find(section.name) == processed_sections.end());
-                if (is_first_occurrence) {
-                    processed_sections.insert(section.name);
-                }
-                
-                // add notes
-                SightRead::Tick last_note_tick = loop_offset;
-                int notes_this_section = 0;
-                bool is_first_note_of_section = true;
-                
-                for (const auto& note : section_notes) {
-                    if (current_notes >= target_notes) break;
-                    
-                    SightRead::Note new_note = note;
-                    new_note.position = SightRead::Tick(note.position.value() - original_offset.value() + loop_offset.value());
-                    
-                    // if first note of section and its a hopo, make it a tap
-                    if (is_first_note_of_section && is_first_occurrence) {
-                        if (new_note.flags & SightRead::FLAGS_HOPO) {
-                            // remove hopo, add tap
-                            new_note.flags = static_cast<SightRead::NoteFlags>(
-                                (new_note.flags & ~SightRead::FLAGS_HOPO) | SightRead::FLAGS_TAP
-                            );
-                        }
-                    }
-                    is_first_note_of_section = false;
-                    
-                    result.push_back(new_note);
-                    last_note_tick = new_note.position;
-                    ++current_notes;
-                    ++notes_this_section;
-                }
-                
-                // audio segment
-                double audio_start = tempo_map.to_seconds(section.start).value();
-                double audio_duration;
-                
-                if (current_notes >= target_notes && notes_this_section < static_cast<int>(section_notes.size())) {
-                    SightRead::Tick relative_last = SightRead::Tick(last_note_tick.value() - loop_offset.value() + original_offset.value());
-                    audio_duration = tempo_map.to_seconds(relative_last).value() - audio_start + 0.5;
-                } else {
-                    audio_duration = section.duration_seconds;
-                }
-                
-                GenerationResult::AudioSegment audio_seg;
-                audio_seg.start_seconds = audio_start;
-                audio_seg.duration_seconds = audio_duration;
-                audio_seg.repeat_count = 1;
-                out_audio_segments.push_back(audio_seg);
-                
-                current_tick = current_tick + section_duration;
-            }
+            notes_begin += unit.notes.size();
+            loop_offset += (unit.source_end - unit.source_start).value();
         }
     }
     
-    return result;
+    return LoopPlan(std::move(units), std::move(steps));
 }
 
 } // namespace NoteGen
-
@@ -0,0 +1,87 @@
+#include "loop_plan.hpp"
+#include <algorithm>
+
+namespace NoteGen {
+
+LoopPlan::LoopPlan(std::shared_ptr<const std::vector<LoopUnit>> units, std::vector<LoopStep> steps)
+    : m_units(std::move(units))
+    , m_steps(std::move(steps)) {
+}
+
+size_t LoopPlan::note_count() const {
+    if (m_steps.empty()) return 0;
+    return m_steps.back().notes_begin + m_steps.back().emit_count;
+}
+
+std::vector<SyncTrackEvent> LoopPlan::sync_events(int resolution) const {
+    // steps are in tick order so the sync track is too
+    SyncTrackBuilder sync_track(resolution);
+
+    for (const auto& step : m_steps) {
+        for (const auto& event : unit(step).sync_events) {
+            SyncTrackEvent shifted = event;
+            shifted.position = SightRead::Tick(event.position.value() + step.loop_offset.value());
+            sync_track.add(shifted);
+        }
+    }
+
+    return sync_track.take();
+}
+
+std::vector<LoopedSection> LoopPlan::looped_sections() const {
+    std::vector<LoopedSection> sections;
+
+    for (const auto& step : m_steps) {
+        for (const auto& marker : unit(step).markers) {
+            LoopedSection looped_sec = marker;
+            looped_sec.name = marker.name + " " + std::to_string(step.pass);
+            looped_sec.start = SightRead::Tick(marker.start.value() + step.loop_offset.value());
+            looped_sec.end = SightRead::Tick(marker.end.value() + step.loop_offset.value());
+            sections.push_back(looped_sec);
+        }
+    }
+
+    return sections;
+}
+
+AudioTimeline LoopPlan::audio_timeline() const {
+    AudioTimeline timeline;
+
+    auto same = [](const AudioSegment& a, const AudioSegment& b) {
+        return a.start_seconds == b.start_seconds && a.duration_seconds == b.duration_seconds
+               && a.repeat_count == b.repeat_count;
+    };
+    auto same_pass = [&](const std::vector<AudioSegment>& a, const std::vector<AudioSegment>& b) {
+        return std::equal(a.begin(), a.end(), b.begin(), b.end(), same);
+    };
+
+    for (size_t i = 0; i < m_steps.size();) {
+        // one pass, back to back repeats of a segment fold into its repeat_count
+        std::vector<AudioSegment> pass;
+        const int pass_number = m_steps[i].pass;
+        for (; i < m_steps.size() && m_steps[i].pass == pass_number; ++i) {
+            AudioSegment audio_seg;
+            audio_seg.start_seconds = unit(m_steps[i]).audio_start_seconds;
+            audio_seg.duration_seconds = m_steps[i].audio_duration_seconds;
+            audio_seg.repeat_count = 1;
+
+            if (!pass.empty() && pass.back().start_seconds == audio_seg.start_seconds
+                && pass.back().duration_seconds == audio_seg.duration_seconds) {
+                ++pass.back().repeat_count;
+            } else {
+                pass.push_back(audio_seg);
+            }
+        }
+
+        // passes sound the same until the last one gets cut short
+        if (!timeline.empty() && same_pass(timeline.back().segments, pass)) {
+            ++timeline.back().repeat_count;
+        } else {
+            timeline.push_back({std::move(pass), 1});
+        }
+    }
+
+    return timeline;
+}
+
+} // namespace NoteGen
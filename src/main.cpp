@@ -15,15 +15,20 @@
 #include <memory>
 #include <set>
 #include <functional>
+#include <atomic>
+#include <stop_token>
+#include <thread>
 
 #include <sightread/chartparser.hpp>
 #include <sightread/midiparser.hpp>
 #include <nlohmann/json.hpp>
 
+#include "audio_jobs.hpp"
 #include "chart_info.hpp"
 #include "loop_generator.hpp"
 #include "chart_writer.hpp"
 #include "ini_parser.hpp"
+#include "song_io.hpp"
 
 using json = nlohmann::json;
 namespace fs = std::filesystem;
@@ -86,202 +91,6 @@ std::string find_ffmpeg() {
     return "";
 }
 
-// progress callback
-using ProgressCallback = std::function<void(int percent, const std::string& status)>;
-
-bool process_audio_with_ffmpeg(const std::string& source_path, 
-                                const std::string& dest_path,
-                                const std::vector<NoteGen::GenerationResult::AudioSegment>& segments,
-                                bool is_full_song,
-                                std::string& error_out,
-                                ProgressCallback progress_cb = nullptr) {
-    if (g_ffmpeg_path.empty() || segments.empty()) {
-        return false;
-    }
-    
-    // build the filter
-    std::vector<std::string> filter_parts;
-    int stream_index = 0;
-    double total_duration = 0.0;
-    
-    for (const auto& seg : segments) {
-        char start_str[32], dur_str[32];
-        snprintf(start_str, sizeof(start_str), "%.3f", seg.start_seconds);
-        snprintf(dur_str, sizeof(dur_str), "%.3f", seg.duration_seconds);
-        
-        for (int i = 0; i < seg.repeat_count; i++) {
-            std::string part = "[0:a]atrim=start=" + std::string(start_str) + 
-                              ":duration=" + std::string(dur_str) + 
-                              ",asetpts=PTS-STARTPTS[s" + std::to_string(stream_index) + "]";
-            filter_parts.push_back(part);
-            stream_index++;
-            total_duration += seg.duration_seconds;
-        }
-    }
-    
-    if (stream_index == 0) {
-        return false;
-    }
-    
-    // concat inputs
-    std::string concat_inputs;
-    for (int i = 0; i < stream_index; i++) {
-        concat_inputs += "[s" + std::to_string(i) + "]";
-    }
-    
-    // build filter complex
-    std::string filter_complex;
-    for (size_t i = 0; i < filter_parts.size(); i++) {
-        if (i > 0) filter_complex += ";";
-        filter_complex += filter_parts[i];
-    }
-    
-    filter_complex += ";" + concat_inputs + "concat=n=" + std::to_string(stream_index) + ":v=0:a=1";
-    
-    if (is_full_song) {
-        double fade_duration = 1.0;
-        double fade_start = std::max(0.0, total_duration - fade_duration);
-        char fade_start_str[32];
-        snprintf(fade_start_str, sizeof(fade_start_str), "%.3f", fade_start);
-        filter_complex += "[concat];[concat]afade=t=out:st=" + std::string(fade_start_str) + ":d=1.0[out]";
-    } else {
-        filter_complex += "[out]";
-    }
-    
-    // write filter to temp file
-    std::string filter_path = fs::path(dest_path).parent_path().string() + "\\ffmpeg_filter.txt";
-    {
-        std::ofstream filter_file(filter_path);
-        filter_file << filter_complex;
-    }
-    
-    // pipe for ffmpeg progress
-    HANDLE hReadPipe, hWritePipe;
-    SECURITY_ATTRIBUTES sa = {sizeof(SECURITY_ATTRIBUTES), NULL, TRUE};
-    if (!CreatePipe(&hReadPipe, &hWritePipe, &sa, 0)) {
-        error_out = "Failed to create pipe";
-        DeleteFileA(filter_path.c_str());
-        return false;
-    }
-    
-    // dont inherit read handle
-    SetHandleInformation(hReadPipe, HANDLE_FLAG_INHERIT, 0);
-    
-    // ffmpeg command with progress output
-    std::string cmdline = "\"" + g_ffmpeg_path + "\" -y -progress pipe:1 -i \"" + source_path + 
-                         "\" -filter_complex_script \"" + filter_path + 
-                         "\" -map \"[out]\" \"" + dest_path + "\"";
-    
-    STARTUPINFOA si = {0};
-    si.cb = sizeof(si);
-    si.dwFlags = STARTF_USESHOWWINDOW | STARTF_USESTDHANDLES;
-    si.wShowWindow = SW_HIDE;
-    si.hStdOutput = hWritePipe;
-    si.hStdError = hWritePipe;
-    si.hStdInput = NULL;
-    
-    PROCESS_INFORMATION pi = {0};
-    
-    std::vector<char> cmdline_buf(cmdline.begin(), cmdline.end());
-    cmdline_buf.push_back('\0');
-    
-    if (!CreateProcessA(
-            g_ffmpeg_path.c_str(),
-            cmdline_buf.data(),
-            NULL, NULL, TRUE,  // Inherit handles = TRUE
-            CREATE_NO_WINDOW,
-            NULL, NULL, &si, &pi)) {
-        error_out = "Failed to start FFmpeg (error " + std::to_string(GetLastError()) + ")";
-        CloseHandle(hReadPipe);
-        CloseHandle(hWritePipe);
-        DeleteFileA(filter_path.c_str());
-        return false;
-    }
-    
-    // close write end in parent
-    CloseHandle(hWritePipe);
-    
-    // read progress output
-    char buffer[256];
-    DWORD bytesRead;
-    std::string accumulated;
-    double current_time = 0.0;
-    
-    while (true) {
-        // check if still running
-        DWORD wait_result = WaitForSingleObject(pi.hProcess, 0);
-        
-        // try to read
-        DWORD available = 0;
-        PeekNamedPipe(hReadPipe, NULL, 0, NULL, &available, NULL);
-        
-        if (available > 0) {
-            if (ReadFile(hReadPipe, buffer, std::min(available, (DWORD)sizeof(buffer)-1), &bytesRead, NULL) && bytesRead > 0) {
-                buffer[bytesRead] = '\0';
-                accumulated += buffer;
-                
-                // parse out_time_ms
-                size_t pos;
-                while ((pos = accumulated.find("out_time_ms=")) != std::string::npos) {
-                    size_t end = accumulated.find('\n', pos);
-                    if (end != std::string::npos) {
-                        std::string time_str = accumulated.substr(pos + 12, end - pos - 12);
-                        try {
-                            double time_ms = std::stod(time_str);
-                            current_time = time_ms / 1000000.0;  // microseconds to seconds
-                            
-                            if (progress_cb && total_duration > 0) {
-                                int percent = std::min(100, (int)(current_time / total_duration * 100));
-                                char status[64];
-                                snprintf(status, sizeof(status), "%.1f / %.1f sec", current_time, total_duration);
-                                progress_cb(percent, status);
-                            }
-                        } catch (...) {}
-                        accumulated = accumulated.substr(end + 1);
-                    } else {
-                        break;
-                    }
-                }
-                
-                // keep only recent data
-                if (accumulated.size() > 1024) {
-                    accumulated = accumulated.substr(accumulated.size() - 512);
-                }
-            }
-        }
-        
-        if (wait_result == WAIT_OBJECT_0) {
-            // done, drain remaining output
-            while (ReadFile(hReadPipe, buffer, sizeof(buffer)-1, &bytesRead, NULL) && bytesRead > 0) {
-            }
-            break;
-        }
-        
-        Sleep(50);  // dont spin too hard
-    }
-    
-    CloseHandle(hReadPipe);
-    
-    DWORD exit_code = 1;
-    GetExitCodeProcess(pi.hProcess, &exit_code);
-    
-    CloseHandle(pi.hProcess);
-    CloseHandle(pi.hThread);
-    
-    DeleteFileA(filter_path.c_str());
-    
-    if (progress_cb) {
-        progress_cb(100, "Complete");
-    }
-    
-    if (exit_code != 0) {
-        error_out = "FFmpeg exited with code " + std::to_string(exit_code);
-        return false;
-    }
-    
-    return true;
-}
-
 #pragma comment(lib, "comctl32.lib")
 #pragma comment(linker, "\"/manifestdependency:type='win32' \
 name='Microsoft.Windows.Common-Controls' version='6.0.0.0' \
@@ -302,6 +111,7 @@ processorArchitecture='*' publicKeyToken='6595b64144ccf1df' language='*'\"")
 #define ID_GENERATE_BTN     111
 #define ID_OPEN_FOLDER_BTN  112
 #define ID_NEW_BTN          113
+#define ID_FAST_AUDIO_CHECK 114
 
 // app state
 
@@ -345,6 +155,7 @@ static HWND g_instrument_combo = NULL;
 static HWND g_difficulty_combo = NULL;
 static HWND g_sections_list = NULL;
 static HWND g_generate_btn = NULL;
+static HWND g_fast_audio_check = NULL;
 static HWND g_selected_label = NULL;
 static HWND g_result_group = NULL;
 static HWND g_result_label = NULL;
@@ -352,43 +163,6 @@ static HWND g_open_folder_btn = NULL;
 
 // helpers
 
-std::string read_file_content(const std::string& path) {
-    std::ifstream file(path, std::ios::binary);
-    if (!file) {
-        throw std::runtime_error("Cannot open file: " + path);
-    }
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    std::string content = buffer.str();
-    
-    // strip utf8 bom if there
-    const std::string utf8_bom = "\xEF\xBB\xBF";
-    if (content.size() >= 3 && content.substr(0, 3) == utf8_bom) {
-        content = content.substr(3);
-    }
-    
-    return content;
-}
-
-SightRead::Instrument string_to_instrument(const std::string& str) {
-    if (str == "Guitar") return SightRead::Instrument::Guitar;
-    if (str == "Bass") return SightRead::Instrument::Bass;
-    if (str == "Rhythm") return SightRead::Instrument::Rhythm;
-    if (str == "Keys") return SightRead::Instrument::Keys;
-    if (str == "Drums") return SightRead::Instrument::Drums;
-    if (str == "GHLGuitar") return SightRead::Instrument::GHLGuitar;
-    if (str == "GHLBass") return SightRead::Instrument::GHLBass;
-    return SightRead::Instrument::Guitar;
-}
-
-SightRead::Difficulty string_to_difficulty(const std::string& str) {
-    if (str == "Easy") return SightRead::Difficulty::Easy;
-    if (str == "Medium") return SightRead::Difficulty::Medium;
-    if (str == "Hard") return SightRead::Difficulty::Hard;
-    if (str == "Expert") return SightRead::Difficulty::Expert;
-    return SightRead::Difficulty::Expert;
-}
-
 std::string get_selected_instrument() {
     int idx = (int)SendMessage(g_instrument_combo, CB_GETCURSEL, 0, 0);
     if (idx >= 0 && idx < (int)g_state.instruments.size()) {
@@ -425,8 +199,8 @@ void update_selected_notes() {
 void update_track_info() {
     if (!g_state.song) return;
     
-    auto instrument = string_to_instrument(get_selected_instrument());
-    auto difficulty = string_to_difficulty(get_selected_difficulty());
+    auto instrument = NoteGen::string_to_instrument(get_selected_instrument());
+    auto difficulty = NoteGen::string_to_difficulty(get_selected_difficulty());
     
     json info_json = NoteGen::song_to_json(*g_state.song, g_state.ini_data, instrument, difficulty);
     g_state.total_notes = info_json["total_notes"];
@@ -457,23 +231,7 @@ void update_track_info() {
 
 bool load_chart(const std::string& path) {
     try {
-        std::string content = read_file_content(path);
-    std::string extension = fs::path(path).extension().string();
-    
-    SightRead::Metadata metadata;
-    
-    if (extension == ".chart") {
-        SightRead::ChartParser parser(metadata);
-            g_state.song = std::make_unique<SightRead::Song>(parser.parse(content));
-    } else if (extension == ".mid" || extension == ".midi") {
-        SightRead::MidiParser parser(metadata);
-            g_state.song = std::make_unique<SightRead::Song>(
-                parser.parse(std::vector<std::uint8_t>(content.begin(), content.end()))
-            );
-    } else {
-            MessageBoxA(g_hwnd, ("Unknown file format: " + extension).c_str(), "Error", MB_OK | MB_ICONERROR);
-            return false;
-}
+        g_state.song = NoteGen::load_song(path);
 
         g_state.chart_path = path;
         g_state.chart_dir = fs::path(path).parent_path().string();
@@ -539,6 +297,85 @@ bool load_chart(const std::string& path) {
     }
 }
 
+// decoded stems survive regenerating with another target or selection
+static const uint64_t PCM_CACHE_BYTES = 2ull << 30;
+static std::unique_ptr<NoteGen::PcmCache> g_pcm_cache;
+
+// set while stems are being looped, the generate button cancels through it
+static std::stop_source* g_audio_stop = NULL;
+
+// loop the stems on a worker thread and keep the ui alive until they're done
+std::vector<NoteGen::StemResult> run_stems(const std::vector<NoteGen::StemJob>& stems,
+                                           const NoteGen::AudioTimeline& timeline,
+                                           const NoteGen::StemOptions& options) {
+    NoteGen::StemProgress progress(stems.size());
+    std::stop_source stop;
+    std::vector<NoteGen::StemResult> results;
+    std::atomic<bool> finished = false;
+    
+    std::thread worker([&] {
+        results = NoteGen::process_stems(g_ffmpeg_path, stems, timeline, options, progress, stop.get_token());
+        finished = true;
+        PostMessage(g_hwnd, WM_NULL, 0, 0);  // wake the loop below
+    });
+    
+    g_audio_stop = &stop;
+    SetWindowTextA(g_generate_btn, "Cancel");
+    
+    bool quitting = false;
+    WPARAM quit_code = 0;
+    std::string last_msg;
+    
+    while (!finished) {
+        MsgWaitForMultipleObjects(0, NULL, FALSE, 100, QS_ALLINPUT);
+        
+        // pump messages so ui doesnt freeze
+        MSG msg_struct;
+        while (PeekMessage(&msg_struct, NULL, 0, 0, PM_REMOVE)) {
+            if (msg_struct.message == WM_QUIT) {
+                // window closed, stop and quit once the workers are out
+                quitting = true;
+                quit_code = msg_struct.wParam;
+                stop.request_stop();
+                continue;
+            }
+            TranslateMessage(&msg_struct);
+            DispatchMessage(&msg_struct);
+        }
+        
+        // ascii progress bar for the whole batch, then the stems in flight
+        int percent = (int)(progress.total_fraction() * 100);
+        int filled = percent / 5;  // 20 chars total
+        std::string bar = "[";
+        for (int i = 0; i < 20; i++) {
+            bar += (i < filled) ? '#' : ' ';
+        }
+        bar += "] " + std::to_string(percent) + "%";
+        
+        std::string msg = stop.stop_requested() ? "Cancelling... " : "Looping audio ";
+        msg += std::to_string(progress.finished()) + "/" + std::to_string(stems.size()) + "  " + bar;
+        for (size_t i = 0; i < stems.size(); i++) {
+            if (progress.state(i) == NoteGen::StemState::Working) {
+                msg += "  " + fs::path(stems[i].source_path).filename().string() + " " +
+                       std::to_string((int)(progress.fraction(i) * 100)) + "%";
+            }
+        }
+        if (msg != last_msg) {
+            SetWindowTextA(g_status_label, msg.c_str());
+            last_msg = msg;
+        }
+    }
+    
+    worker.join();
+    g_audio_stop = NULL;
+    SetWindowTextA(g_generate_btn, "Generate Chart");
+    
+    if (quitting) {
+        PostQuitMessage((int)quit_code);
+    }
+    return results;
+}
+
 bool generate_chart() {
     // get output folder
     char folder_path[MAX_PATH] = {0};
@@ -557,8 +394,8 @@ bool generate_chart() {
     std::string output_dir = folder_path;
     
     try {
-        auto instrument = string_to_instrument(get_selected_instrument());
-        auto difficulty = string_to_difficulty(get_selected_difficulty());
+        auto instrument = NoteGen::string_to_instrument(get_selected_instrument());
+        auto difficulty = NoteGen::string_to_difficulty(get_selected_difficulty());
         
         // target notes
         char target_str[32];
@@ -599,93 +436,61 @@ bool generate_chart() {
         std::string final_output = output_dir + "\\" + result.folder_name;
         fs::create_directories(final_output);
         
-        // write chart (with utf8 bom)
-        std::string chart_path = final_output + "\\notes.chart";
-        std::ofstream chart_file(chart_path, std::ios::binary);
-        const unsigned char bom[] = {0xEF, 0xBB, 0xBF};
-        chart_file.write(reinterpret_cast<const char*>(bom), 3);
-        chart_file << result.chart_data;
-        chart_file.close();
-        
-        // write song.ini
-        std::string ini_path = final_output + "\\song.ini";
-        std::ofstream ini_file(ini_path);
-        ini_file << "[Song]\n";
-        ini_file << "name = " << result.chart_name << "\n";
-        ini_file << "artist = " << (g_state.ini_data.artist.empty() ? g_state.song->global_data().artist() : g_state.ini_data.artist) << "\n";
-        ini_file << "charter = " << (g_state.ini_data.charter.empty() ? g_state.song->global_data().charter() : g_state.ini_data.charter) << "\n";
-        ini_file << "album = " << g_state.ini_data.album << "\n";
-        ini_file << "genre = Practice\n";
-        ini_file << "year = " << g_state.ini_data.year << "\n";
-        ini_file.close();
+        // write chart and song.ini
+        NoteGen::write_generated_chart(final_output, result, *g_state.song, g_state.ini_data);
         
         // copy/process audio and images
-        std::vector<std::string> audio_exts = {".ogg", ".opus", ".mp3", ".wav"};
         std::vector<std::string> image_exts = {".png", ".jpg", ".jpeg"};
         
-        bool has_ffmpeg = !g_ffmpeg_path.empty();
+        bool has_ffmpeg = !g_ffmpeg_path.empty() && !result.audio_timeline.empty();
         int audio_processed = 0;
         int audio_copied = 0;
+        std::vector<NoteGen::StemJob> stems;
         
         for (const auto& entry : fs::directory_iterator(g_state.chart_dir)) {
             std::string ext = entry.path().extension().string();
             std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
             
-            bool is_audio = std::find(audio_exts.begin(), audio_exts.end(), ext) != audio_exts.end();
+            bool is_audio = NoteGen::is_audio_file(entry.path().string());
             bool is_image = std::find(image_exts.begin(), image_exts.end(), ext) != image_exts.end();
+            std::string dest = final_output + "\\" + entry.path().filename().string();
             
-            if (is_image) {
-                std::string dest = final_output + "\\" + entry.path().filename().string();
+            if (is_audio && has_ffmpeg) {
+                stems.push_back({entry.path().string(), dest});
+            }
+            else if (is_image || is_audio) {
+                // no ffmpeg, just copy
                 try {
                     fs::copy_file(entry.path(), dest, fs::copy_options::overwrite_existing);
+                    if (is_audio) audio_copied++;
                 } catch (...) {}
             }
-            else if (is_audio) {
-                std::string dest = final_output + "\\" + entry.path().filename().string();
-                
-                if (has_ffmpeg && !result.audio_segments.empty()) {
-                    // process with ffmpeg
-                    std::string filename = entry.path().filename().string();
-                    
-                    auto progress_callback = [&filename](int percent, const std::string& status) {
-                        // ascii progress bar
-                        int filled = percent / 5;  // 20 chars total
-                        std::string bar = "[";
-                        for (int i = 0; i < 20; i++) {
-                            bar += (i < filled) ? '#' : ' ';
-                        }
-                        bar += "] " + std::to_string(percent) + "% - " + status;
-                        
-                        std::string msg = "Processing " + filename + "  " + bar;
-                        SetWindowTextA(g_status_label, msg.c_str());
-                        UpdateWindow(g_hwnd);
-                        
-                        // pump messages so ui doesnt freeze
-                        MSG msg_struct;
-                        while (PeekMessage(&msg_struct, NULL, 0, 0, PM_REMOVE)) {
-                            TranslateMessage(&msg_struct);
-                            DispatchMessage(&msg_struct);
-                        }
-                    };
-                    
-                    progress_callback(0, "Starting...");
-                    
-                    std::string ffmpeg_error;
-                    if (process_audio_with_ffmpeg(entry.path().string(), dest, 
-                                                   result.audio_segments, result.is_full_song,
-                                                   ffmpeg_error, progress_callback)) {
-                        audio_processed++;
-                    } else {
-                        // ffmpeg failed, just copy
-                        try {
-                            fs::copy_file(entry.path(), dest, fs::copy_options::overwrite_existing);
-                            audio_copied++;
-                        } catch (...) {}
-                    }
+        }
+        
+        bool cancelled = false;
+        if (!stems.empty()) {
+            NoteGen::StemOptions options;
+            options.fade_out = result.is_full_song;
+            options.stream_copy = SendMessage(g_fast_audio_check, BM_GETCHECK, 0, 0) == BST_CHECKED;
+            
+            if (!g_pcm_cache) {
+                std::error_code ec;
+                fs::path cache_dir = fs::temp_directory_path(ec) / "NoteAmountGen" / "pcm";
+                g_pcm_cache = std::make_unique<NoteGen::PcmCache>(cache_dir.string(), PCM_CACHE_BYTES);
+            }
+            options.cache = g_pcm_cache.get();
+            
+            auto results = run_stems(stems, result.audio_timeline, options);
+            
+            for (size_t i = 0; i < stems.size(); i++) {
+                if (results[i].state == NoteGen::StemState::Done) {
+                    audio_processed++;
+                } else if (results[i].state == NoteGen::StemState::Cancelled) {
+                    cancelled = true;
                 } else {
-                    // no ffmpeg, just copy
+                    // ffmpeg failed, just copy
                     try {
-                        fs::copy_file(entry.path(), dest, fs::copy_options::overwrite_existing);
+                        fs::copy_file(stems[i].source_path, stems[i].dest_path, fs::copy_options::overwrite_existing);
                         audio_copied++;
                     } catch (...) {}
                 }
@@ -703,7 +508,9 @@ bool generate_chart() {
         int secs = (int)result.total_duration_seconds % 60;
         
         std::string audio_status;
-        if (audio_processed > 0) {
+        if (cancelled) {
+            audio_status = " (audio cancelled)";
+        } else if (audio_processed > 0) {
             audio_status = " (audio looped)";
         } else if (audio_copied > 0) {
             audio_status = " (audio copied, no FFmpeg)";
@@ -831,7 +638,11 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
                     break;
                     
                 case ID_GENERATE_BTN:
-                    generate_chart();
+                    if (g_audio_stop) {
+                        g_audio_stop->request_stop();
+                    } else {
+                        generate_chart();
+                    }
                     break;
                     
                 case ID_OPEN_FOLDER_BTN:
@@ -1028,6 +839,10 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     SendMessage(g_generate_btn, WM_SETFONT, (WPARAM)hFont, TRUE);
     EnableWindow(g_generate_btn, FALSE);
     
+    g_fast_audio_check = CreateWindowExA(0, "BUTTON", "Fast audio (copy packets)", WS_CHILD | WS_VISIBLE | BS_AUTOCHECKBOX,
+                                         145, y + 5, 220, 20, g_hwnd, (HMENU)ID_FAST_AUDIO_CHECK, hInstance, NULL);
+    SendMessage(g_fast_audio_check, WM_SETFONT, (WPARAM)hFont, TRUE);
+    
     y += 40;
     
     // result (hidden at start)
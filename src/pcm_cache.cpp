@@ -0,0 +1,189 @@
+#include "pcm_cache.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace NoteGen {
+
+namespace {
+
+constexpr char MAGIC[8] = {'N', 'A', 'G', 'P', 'C', 'M', '1', '\0'};
+
+// fixed size so the samples after it stay float aligned in the mapping
+struct EntryHeader {
+    char magic[8];
+    uint32_t sample_rate;
+    uint32_t channels;
+    uint64_t sample_count;
+    uint64_t reserved;
+};
+static_assert(sizeof(EntryHeader) == 32);
+
+// 64-bit fnv-1a over 8 byte words, the file is read far faster than ffmpeg
+// could decode it
+uint64_t content_hash(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Cannot open " + path);
+    }
+
+    constexpr uint64_t PRIME = 0x100000001b3ull;
+    uint64_t hash = 0xcbf29ce484222325ull;
+    std::vector<char> buffer(1 << 20);
+    while (file) {
+        file.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        size_t got = static_cast<size_t>(file.gcount());
+        size_t i = 0;
+        for (; i + 8 <= got; i += 8) {
+            uint64_t word;
+            std::memcpy(&word, buffer.data() + i, 8);
+            hash = (hash ^ word) * PRIME;
+        }
+        for (; i < got; ++i) {
+            hash = (hash ^ static_cast<unsigned char>(buffer[i])) * PRIME;
+        }
+    }
+    return hash;
+}
+
+} // namespace
+
+PcmCache::PcmCache(std::string directory, uint64_t max_bytes)
+    : m_directory(std::move(directory))
+    , m_max_bytes(max_bytes) {
+}
+
+std::string PcmCache::entry_path(const std::string& source_path, int sample_rate) const {
+    // size too, so a hash collision would also need the same length
+    char name[96];
+    snprintf(name, sizeof(name), "%016llx-%llu-%d.pcm",
+             static_cast<unsigned long long>(content_hash(source_path)),
+             static_cast<unsigned long long>(fs::file_size(source_path)), sample_rate);
+    return (fs::path(m_directory) / name).string();
+}
+
+bool PcmCache::load(const std::string& path, PcmAudio& audio) const {
+    auto mapped = std::make_shared<const MappedFile>(path);
+    if (mapped->size() < sizeof(EntryHeader)) return false;
+
+    EntryHeader header;
+    std::memcpy(&header, mapped->data(), sizeof(header));
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.channels == 0 ||
+        header.sample_count % header.channels != 0 ||
+        mapped->size() != sizeof(EntryHeader) + header.sample_count * sizeof(float)) {
+        return false;
+    }
+
+    audio.sample_rate = static_cast<int>(header.sample_rate);
+    audio.channels = static_cast<int>(header.channels);
+    audio.mapped_samples = reinterpret_cast<const float*>(mapped->data() + sizeof(EntryHeader));
+    audio.mapped_count = static_cast<size_t>(header.sample_count);
+    audio.mapped = std::move(mapped);
+    return true;
+}
+
+void PcmCache::store(const std::string& path, const PcmAudio& audio) {
+    EntryHeader header = {};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.sample_rate = static_cast<uint32_t>(audio.sample_rate);
+    header.channels = static_cast<uint32_t>(audio.channels);
+    header.sample_count = audio.sample_count();
+
+    // write next to it and rename, nobody ever maps half an entry
+    std::error_code error;
+    fs::create_directories(m_directory, error);
+    std::ostringstream suffix;
+    suffix << ".tmp" << std::this_thread::get_id();
+    std::string temp_path = path + suffix.str();
+    {
+        std::ofstream out(temp_path, std::ios::binary);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(audio.data()),
+                  static_cast<std::streamsize>(audio.sample_count() * sizeof(float)));
+        if (!out) {
+            out.close();
+            fs::remove(temp_path, error);
+            return;
+        }
+    }
+    fs::rename(temp_path, path, error);
+    if (error) {
+        fs::remove(temp_path, error);
+        return;
+    }
+
+    evict();
+}
+
+void PcmCache::evict() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    struct Entry {
+        fs::path path;
+        fs::file_time_type used;
+        uint64_t size;
+    };
+    std::vector<Entry> entries;
+    uint64_t total = 0;
+
+    std::error_code error;
+    for (const auto& item : fs::directory_iterator(m_directory, error)) {
+        if (item.path().extension() != ".pcm") continue;
+        std::error_code item_error;
+        uint64_t size = item.file_size(item_error);
+        auto used = item.last_write_time(item_error);
+        if (item_error) continue;
+        entries.push_back({item.path(), used, size});
+        total += size;
+    }
+    if (total <= m_max_bytes) return;
+
+    // oldest use first, hits bump the write time
+    std::sort(entries.begin(), entries.end(),
+              [](const Entry& a, const Entry& b) { return a.used < b.used; });
+    for (const auto& entry : entries) {
+        if (total <= m_max_bytes) break;
+        if (fs::remove(entry.path, error)) {
+            total -= entry.size;
+        }
+    }
+}
+
+PcmAudio PcmCache::decode(const std::string& ffmpeg_path, const std::string& source_path,
+                          std::stop_token stop, int sample_rate) {
+    std::string path;
+    try {
+        path = entry_path(source_path, sample_rate);
+    } catch (const std::exception&) {
+        // let ffmpeg report the missing file
+        return decode_audio(ffmpeg_path, source_path, stop, sample_rate);
+    }
+
+    PcmAudio audio;
+    std::error_code error;
+    if (fs::exists(path, error)) {
+        try {
+            if (load(path, audio)) {
+                fs::last_write_time(path, fs::file_time_type::clock::now(), error);
+                return audio;
+            }
+        } catch (const std::exception&) {
+        }
+        audio = PcmAudio();
+        fs::remove(path, error);  // broken entry, decode it again
+    }
+
+    audio = decode_audio(ffmpeg_path, source_path, stop, sample_rate);
+    store(path, audio);
+    return audio;
+}
+
+} // namespace NoteGen
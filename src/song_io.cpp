@@ -0,0 +1,132 @@
+#include "song_io.hpp"
+#include "file_source.hpp"
+#include <sightread/chartparser.hpp>
+#include <sightread/midiparser.hpp>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+
+namespace NoteGen {
+
+std::string read_file_content(const std::string& path) {
+    return std::string(FileSource(path).text());
+}
+
+bool is_chart_file(const std::string& path) {
+    std::string ext = fs::path(path).extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext == ".chart" || ext == ".mid" || ext == ".midi";
+}
+
+std::unique_ptr<SightRead::Song> load_song(const std::string& path,
+                                           const std::set<SightRead::Instrument>& instruments,
+                                           const std::set<SightRead::Difficulty>& difficulties,
+                                           unsigned parse_threads) {
+    // the parsers read straight out of the mapping, the song copies what it keeps
+    FileSource source(path);
+    std::string extension = fs::path(path).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+    SightRead::Metadata metadata;
+
+    if (extension == ".chart") {
+        SightRead::ChartParser parser(metadata);
+        parser.thread_count(parse_threads);
+        if (!instruments.empty()) parser.permit_instruments(instruments);
+        if (!difficulties.empty()) parser.permit_difficulties(difficulties);
+        return std::make_unique<SightRead::Song>(parser.parse(source.text()));
+    }
+    if (extension == ".mid" || extension == ".midi") {
+        // midi tracks hold every difficulty, so only instruments can be skipped
+        SightRead::MidiParser parser(metadata);
+        parser.thread_count(parse_threads);
+        if (!instruments.empty()) parser.permit_instruments(instruments);
+        return std::make_unique<SightRead::Song>(parser.parse(source.bytes()));
+    }
+
+    throw std::runtime_error("Unknown file format: " + extension);
+}
+
+SightRead::Instrument string_to_instrument(const std::string& str) {
+    if (str == "Guitar") return SightRead::Instrument::Guitar;
+    if (str == "Bass") return SightRead::Instrument::Bass;
+    if (str == "Rhythm") return SightRead::Instrument::Rhythm;
+    if (str == "Keys") return SightRead::Instrument::Keys;
+    if (str == "Drums") return SightRead::Instrument::Drums;
+    if (str == "GHLGuitar") return SightRead::Instrument::GHLGuitar;
+    if (str == "GHLBass") return SightRead::Instrument::GHLBass;
+    return SightRead::Instrument::Guitar;
+}
+
+SightRead::Difficulty string_to_difficulty(const std::string& str) {
+    if (str == "Easy") return SightRead::Difficulty::Easy;
+    if (str == "Medium") return SightRead::Difficulty::Medium;
+    if (str == "Hard") return SightRead::Difficulty::Hard;
+    if (str == "Expert") return SightRead::Difficulty::Expert;
+    return SightRead::Difficulty::Expert;
+}
+
+std::string instrument_to_string(SightRead::Instrument instrument) {
+    switch (instrument) {
+        case SightRead::Instrument::Guitar: return "Guitar";
+        case SightRead::Instrument::GuitarCoop: return "GuitarCoop";
+        case SightRead::Instrument::Bass: return "Bass";
+        case SightRead::Instrument::Rhythm: return "Rhythm";
+        case SightRead::Instrument::Keys: return "Keys";
+        case SightRead::Instrument::GHLGuitar: return "GHLGuitar";
+        case SightRead::Instrument::GHLBass: return "GHLBass";
+        case SightRead::Instrument::GHLRhythm: return "GHLRhythm";
+        case SightRead::Instrument::GHLGuitarCoop: return "GHLGuitarCoop";
+        case SightRead::Instrument::Drums: return "Drums";
+        default: return "Unknown";
+    }
+}
+
+std::string difficulty_to_string(SightRead::Difficulty difficulty) {
+    switch (difficulty) {
+        case SightRead::Difficulty::Easy: return "Easy";
+        case SightRead::Difficulty::Medium: return "Medium";
+        case SightRead::Difficulty::Hard: return "Hard";
+        case SightRead::Difficulty::Expert: return "Expert";
+    }
+    return "Expert";
+}
+
+void write_generated_chart(const std::string& output_dir,
+                           const GenerationResult& result,
+                           const SightRead::Song& song,
+                           const SongIniData& ini_data,
+                           unsigned writer_threads) {
+    fs::create_directories(output_dir);
+
+    // write chart (with utf8 bom), streamed straight from the loop plan
+    std::ofstream chart_file(fs::path(output_dir) / "notes.chart", std::ios::binary);
+    if (!chart_file) {
+        throw std::runtime_error("Cannot write chart to: " + output_dir);
+    }
+    const unsigned char bom[] = {0xEF, 0xBB, 0xBF};
+    chart_file.write(reinterpret_cast<const char*>(bom), 3);
+    ChartWriter writer;
+    writer.set_thread_count(writer_threads);
+    write_chart(chart_file, result, writer);
+    chart_file.close();
+    if (!chart_file) {
+        throw std::runtime_error("Failed writing chart to: " + output_dir);
+    }
+
+    // write song.ini
+    std::ofstream ini_file(fs::path(output_dir) / "song.ini");
+    ini_file << "[Song]\n";
+    ini_file << "name = " << result.chart_name << "\n";
+    ini_file << "artist = " << (ini_data.artist.empty() ? song.global_data().artist() : ini_data.artist) << "\n";
+    ini_file << "charter = " << (ini_data.charter.empty() ? song.global_data().charter() : ini_data.charter) << "\n";
+    ini_file << "album = " << ini_data.album << "\n";
+    ini_file << "genre = Practice\n";
+    ini_file << "year = " << ini_data.year << "\n";
+    ini_file.close();
+}
+
+} // namespace NoteGen
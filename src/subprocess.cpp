@@ -0,0 +1,462 @@
+#include "subprocess.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#ifndef _WIN32_WINNT
+#define _WIN32_WINNT 0x0600  // proc thread attribute lists
+#endif
+#include <windows.h>
+#else
+#include <csignal>
+#include <ctime>
+#include <fcntl.h>
+#include <pthread.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+#endif
+
+namespace NoteGen {
+
+#ifdef _WIN32
+
+namespace {
+
+// quote one argument the way CommandLineToArgvW splits them back up
+std::string quote_argument(const std::string& arg) {
+    if (!arg.empty() && arg.find_first_of(" \t\"") == std::string::npos) {
+        return arg;
+    }
+
+    std::string quoted = "\"";
+    size_t backslashes = 0;
+    for (char c : arg) {
+        if (c == '\\') {
+            ++backslashes;
+        } else if (c == '"') {
+            quoted.append(backslashes * 2 + 1, '\\');
+            quoted += '"';
+            backslashes = 0;
+        } else {
+            quoted.append(backslashes, '\\');
+            quoted += c;
+            backslashes = 0;
+        }
+    }
+    quoted.append(backslashes * 2, '\\');
+    quoted += '"';
+    return quoted;
+}
+
+void close_handle(void*& handle) {
+    if (handle) {
+        CloseHandle(static_cast<HANDLE>(handle));
+        handle = nullptr;
+    }
+}
+
+// inheritable duplicate of one of our handles for a child, null if there's
+// nothing to duplicate or it can't be
+HANDLE inheritable_copy(HANDLE handle) {
+    if (handle == NULL || handle == INVALID_HANDLE_VALUE) return NULL;
+    HANDLE copy = NULL;
+    if (!DuplicateHandle(GetCurrentProcess(), handle, GetCurrentProcess(), &copy, 0, TRUE,
+                         DUPLICATE_SAME_ACCESS)) {
+        return NULL;
+    }
+    return copy;
+}
+
+} // namespace
+
+Subprocess::Subprocess(const std::vector<std::string>& args, bool pipe_stdin, bool pipe_stdout) {
+    if (args.empty()) {
+        throw std::runtime_error("No program to run");
+    }
+
+    // Pipes are made non inheritable and the child's ends are duplicated as
+    // inheritable copies, which are then the only handles the child is
+    // allowed to inherit. Several ffmpegs start at once from different
+    // threads, any of them picking up another's pipe would hold its eof back.
+    HANDLE child_stdin = NULL;
+    HANDLE child_stdout = NULL;
+    HANDLE child_stderr = NULL;
+    auto close_child_handles = [&] {
+        if (child_stdin) CloseHandle(child_stdin);
+        if (child_stdout) CloseHandle(child_stdout);
+        if (child_stderr) CloseHandle(child_stderr);
+    };
+    auto fail = [&](const std::string& message) {
+        close_child_handles();
+        close_handle(m_stdin);
+        close_handle(m_stdout);
+        return std::runtime_error(message);
+    };
+
+    if (pipe_stdin) {
+        HANDLE read_end, write_end;
+        if (!CreatePipe(&read_end, &write_end, NULL, 0)) {
+            throw fail("Failed to create pipe");
+        }
+        m_stdin = write_end;
+        child_stdin = inheritable_copy(read_end);
+        CloseHandle(read_end);
+        if (!child_stdin) throw fail("Failed to create pipe");
+    }
+    if (pipe_stdout) {
+        HANDLE read_end, write_end;
+        if (!CreatePipe(&read_end, &write_end, NULL, 0)) {
+            throw fail("Failed to create pipe");
+        }
+        m_stdout = read_end;
+        child_stdout = inheritable_copy(write_end);
+        CloseHandle(write_end);
+        if (!child_stdout) throw fail("Failed to create pipe");
+    } else {
+        child_stdout = inheritable_copy(GetStdHandle(STD_OUTPUT_HANDLE));
+    }
+    // a gui has no stderr, the child then goes without too
+    child_stderr = inheritable_copy(GetStdHandle(STD_ERROR_HANDLE));
+
+    std::vector<HANDLE> inherited;
+    for (HANDLE handle : {child_stdin, child_stdout, child_stderr}) {
+        if (handle) inherited.push_back(handle);
+    }
+
+    SIZE_T attributes_size = 0;
+    InitializeProcThreadAttributeList(NULL, 1, 0, &attributes_size);
+    std::vector<char> attributes_buf(attributes_size);
+    auto attributes = reinterpret_cast<LPPROC_THREAD_ATTRIBUTE_LIST>(attributes_buf.data());
+    if (!InitializeProcThreadAttributeList(attributes, 1, 0, &attributes_size)) {
+        throw fail("Failed to start " + args[0] + " (error " + std::to_string(GetLastError()) + ")");
+    }
+    if (!inherited.empty() &&
+        !UpdateProcThreadAttribute(attributes, 0, PROC_THREAD_ATTRIBUTE_HANDLE_LIST, inherited.data(),
+                                   inherited.size() * sizeof(HANDLE), NULL, NULL)) {
+        DWORD error = GetLastError();
+        DeleteProcThreadAttributeList(attributes);
+        throw fail("Failed to start " + args[0] + " (error " + std::to_string(error) + ")");
+    }
+
+    std::string cmdline;
+    for (size_t i = 0; i < args.size(); ++i) {
+        if (i > 0) cmdline += ' ';
+        cmdline += quote_argument(args[i]);
+    }
+    std::vector<char> cmdline_buf(cmdline.begin(), cmdline.end());
+    cmdline_buf.push_back('\0');
+
+    STARTUPINFOEXA si = {};
+    si.StartupInfo.cb = sizeof(si);
+    si.StartupInfo.dwFlags = STARTF_USESHOWWINDOW | STARTF_USESTDHANDLES;
+    si.StartupInfo.wShowWindow = SW_HIDE;
+    si.StartupInfo.hStdInput = child_stdin;
+    si.StartupInfo.hStdOutput = child_stdout;
+    si.StartupInfo.hStdError = child_stderr;
+    si.lpAttributeList = attributes;
+
+    PROCESS_INFORMATION pi = {0};
+    BOOL started = CreateProcessA(
+        args[0].c_str(),
+        cmdline_buf.data(),
+        NULL, NULL, !inherited.empty(),  // only the handles in the list
+        CREATE_NO_WINDOW | EXTENDED_STARTUPINFO_PRESENT,
+        NULL, NULL, &si.StartupInfo, &pi);
+    DWORD error = GetLastError();
+    DeleteProcThreadAttributeList(attributes);
+
+    // child has its own copies now
+    close_child_handles();
+    child_stdin = child_stdout = child_stderr = NULL;
+
+    if (!started) {
+        throw fail("Failed to start " + args[0] + " (error " + std::to_string(error) + ")");
+    }
+
+    CloseHandle(pi.hThread);
+    m_process = pi.hProcess;
+}
+
+Subprocess::~Subprocess() {
+    if (m_process) {
+        wait();
+    }
+}
+
+size_t Subprocess::read(char* data, size_t size) {
+    if (!m_stdout) return 0;
+    DWORD bytes_read = 0;
+    DWORD to_read = static_cast<DWORD>(std::min<size_t>(size, 1u << 30));
+    if (!ReadFile(static_cast<HANDLE>(m_stdout), data, to_read, &bytes_read, NULL)) {
+        return 0;  // broken pipe = child closed stdout
+    }
+    return bytes_read;
+}
+
+bool Subprocess::write(const char* data, size_t size) {
+    if (!m_stdin) return false;
+    while (size > 0) {
+        DWORD written = 0;
+        DWORD to_write = static_cast<DWORD>(std::min<size_t>(size, 1u << 30));
+        if (!WriteFile(static_cast<HANDLE>(m_stdin), data, to_write, &written, NULL)) {
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+void Subprocess::close_stdin() {
+    close_handle(m_stdin);
+}
+
+void Subprocess::close_stdout() {
+    close_handle(m_stdout);
+}
+
+int Subprocess::wait() {
+    if (m_waited) return m_exit_code;
+
+    close_stdin();
+    close_stdout();
+
+    WaitForSingleObject(static_cast<HANDLE>(m_process), INFINITE);
+    DWORD exit_code = 1;
+    GetExitCodeProcess(static_cast<HANDLE>(m_process), &exit_code);
+    close_handle(m_process);
+
+    m_waited = true;
+    m_exit_code = static_cast<int>(exit_code);
+    return m_exit_code;
+}
+
+void Subprocess::terminate() {
+    if (m_process) {
+        TerminateProcess(static_cast<HANDLE>(m_process), 1);
+    }
+}
+
+#else
+
+namespace {
+
+// Only the dup2'd copies of a pipe may end up in a child. Several ffmpegs
+// start at once from different threads, one that inherited another's pipe
+// would hold its eof back until it exits. pipe2 marks both ends close on
+// exec atomically, without it the pipes are made and the child spawned
+// under one lock so no other spawn can land in between.
+#if defined(__linux__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__) || \
+    defined(__DragonFly__)
+#define NOTEGEN_HAVE_PIPE2 1
+#endif
+
+std::unique_lock<std::mutex> lock_spawns() {
+#ifdef NOTEGEN_HAVE_PIPE2
+    return {};
+#else
+    static std::mutex spawn_mutex;
+    return std::unique_lock<std::mutex>(spawn_mutex);
+#endif
+}
+
+void make_pipe(int fds[2]) {
+#ifdef NOTEGEN_HAVE_PIPE2
+    int result = ::pipe2(fds, O_CLOEXEC);
+#else
+    int result = ::pipe(fds);
+    if (result == 0) {
+        ::fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+        ::fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    }
+#endif
+    if (result != 0) {
+        throw std::runtime_error(std::string("Failed to create pipe: ") + std::strerror(errno));
+    }
+}
+
+// A child that exits early has to fail write() rather than kill us, without
+// touching the process wide SIGPIPE disposition. Where pipes can't opt out
+// of the signal, it's blocked on this thread for the write and one it
+// raised is taken back off the pending set before unblocking.
+#ifndef F_SETNOSIGPIPE
+class SigpipeBlock {
+public:
+    SigpipeBlock() {
+        sigemptyset(&m_sigpipe);
+        sigaddset(&m_sigpipe, SIGPIPE);
+        sigset_t pending;
+        sigpending(&pending);
+        m_was_pending = sigismember(&pending, SIGPIPE) == 1;
+        pthread_sigmask(SIG_BLOCK, &m_sigpipe, &m_old_mask);
+    }
+
+    ~SigpipeBlock() {
+        if (m_raised && !m_was_pending) {
+            const timespec no_wait = {0, 0};
+            while (sigtimedwait(&m_sigpipe, nullptr, &no_wait) < 0 && errno == EINTR) {
+            }
+        }
+        pthread_sigmask(SIG_SETMASK, &m_old_mask, nullptr);
+    }
+
+    SigpipeBlock(const SigpipeBlock&) = delete;
+    SigpipeBlock& operator=(const SigpipeBlock&) = delete;
+
+    void raised() { m_raised = true; }
+
+private:
+    sigset_t m_sigpipe;
+    sigset_t m_old_mask;
+    bool m_was_pending = false;
+    bool m_raised = false;
+};
+#endif
+
+void close_fd(int& fd) {
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+} // namespace
+
+Subprocess::Subprocess(const std::vector<std::string>& args, bool pipe_stdin, bool pipe_stdout) {
+    if (args.empty()) {
+        throw std::runtime_error("No program to run");
+    }
+
+    int stdin_pipe[2] = {-1, -1};
+    int stdout_pipe[2] = {-1, -1};
+
+    auto spawn_lock = lock_spawns();
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+
+    try {
+        if (pipe_stdin) {
+            make_pipe(stdin_pipe);
+            posix_spawn_file_actions_adddup2(&actions, stdin_pipe[0], STDIN_FILENO);
+        } else {
+            posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+        }
+        if (pipe_stdout) {
+            make_pipe(stdout_pipe);
+            posix_spawn_file_actions_adddup2(&actions, stdout_pipe[1], STDOUT_FILENO);
+        }
+    } catch (...) {
+        posix_spawn_file_actions_destroy(&actions);
+        close_fd(stdin_pipe[0]);
+        close_fd(stdin_pipe[1]);
+        close_fd(stdout_pipe[0]);
+        close_fd(stdout_pipe[1]);
+        throw;
+    }
+
+    std::vector<char*> argv;
+    for (const auto& arg : args) {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    pid_t pid = -1;
+    int result = posix_spawnp(&pid, argv[0], &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+
+    // child has its own copies now
+    close_fd(stdin_pipe[0]);
+    close_fd(stdout_pipe[1]);
+    spawn_lock = {};
+    m_stdin = stdin_pipe[1];
+    m_stdout = stdout_pipe[0];
+
+    if (result != 0) {
+        close_fd(m_stdin);
+        close_fd(m_stdout);
+        throw std::runtime_error("Failed to start " + args[0] + ": " + std::strerror(result));
+    }
+#ifdef F_SETNOSIGPIPE
+    if (m_stdin >= 0) {
+        ::fcntl(m_stdin, F_SETNOSIGPIPE, 1);
+    }
+#endif
+    m_pid = pid;
+}
+
+Subprocess::~Subprocess() {
+    if (m_pid > 0) {
+        wait();
+    }
+}
+
+size_t Subprocess::read(char* data, size_t size) {
+    if (m_stdout < 0) return 0;
+    while (true) {
+        ssize_t bytes_read = ::read(m_stdout, data, size);
+        if (bytes_read < 0 && errno == EINTR) continue;
+        return bytes_read > 0 ? static_cast<size_t>(bytes_read) : 0;
+    }
+}
+
+bool Subprocess::write(const char* data, size_t size) {
+    if (m_stdin < 0) return false;
+#ifndef F_SETNOSIGPIPE
+    SigpipeBlock sigpipe_block;
+#endif
+    while (size > 0) {
+        ssize_t written = ::write(m_stdin, data, size);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) {
+#ifndef F_SETNOSIGPIPE
+            if (written < 0 && errno == EPIPE) sigpipe_block.raised();
+#endif
+            return false;
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+void Subprocess::close_stdin() {
+    close_fd(m_stdin);
+}
+
+void Subprocess::close_stdout() {
+    close_fd(m_stdout);
+}
+
+int Subprocess::wait() {
+    if (m_waited) return m_exit_code;
+
+    close_stdin();
+    close_stdout();
+
+    int status = 0;
+    while (::waitpid(m_pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    m_pid = -1;
+
+    m_waited = true;
+    m_exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    return m_exit_code;
+}
+
+void Subprocess::terminate() {
+    if (m_pid > 0) {
+        ::kill(m_pid, SIGTERM);
+    }
+}
+
+#endif
+
+} // namespace NoteGen